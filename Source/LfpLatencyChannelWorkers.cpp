@@ -0,0 +1,137 @@
+/*
+    ------------------------------------------------------------------
+
+    This file is part of APTrack, a plugin for the Open-Ephys Gui
+
+    Copyright (C) 2019-2023 Eli Lilly and Company, University of Bristol, Open Ephys
+    Authors: Aidan Nickerson, Grace Stangroome, Merle Zhang, James O'Sullivan, Manuel Martinez
+
+    ------------------------------------------------------------------
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include "LfpLatencyChannelWorkers.h"
+#include <thread>
+
+LfpLatencyChannelWorkers::Worker::Worker(LfpLatencyChannelWorkers &o, int index)
+    : Thread("APTrack channel worker " + String(index)), owner(o)
+{
+}
+
+void LfpLatencyChannelWorkers::Worker::run()
+{
+    while (!threadShouldExit())
+    {
+        if (!wake.wait(100) || threadShouldExit())
+        {
+            continue;
+        }
+        owner.performUnclaimedShares();
+    }
+}
+
+LfpLatencyChannelWorkers::LfpLatencyChannelWorkers()
+    : job(nullptr), context(nullptr), numChannels(0), numShares(1), nextShare(1), finishedShares(0)
+{
+}
+
+LfpLatencyChannelWorkers::~LfpLatencyChannelWorkers()
+{
+    stop();
+}
+
+void LfpLatencyChannelWorkers::start(int numWorkers)
+{
+    stop();
+
+    // Nothing is claimable until the first job
+    numShares = numWorkers + 1;
+    nextShare.store(numShares);
+    for (int i = 0; i < numWorkers; i++)
+    {
+        workers.emplace_back(new Worker(*this, i + 1));
+        workers.back()->startThread(9);
+    }
+}
+
+void LfpLatencyChannelWorkers::stop()
+{
+    for (auto &worker : workers)
+    {
+        worker->signalThreadShouldExit();
+        worker->wake.signal();
+    }
+    for (auto &worker : workers)
+    {
+        worker->stopThread(500);
+    }
+    workers.clear();
+    numShares = 1;
+}
+
+int LfpLatencyChannelWorkers::getNumWorkers() const
+{
+    return static_cast<int>(workers.size());
+}
+
+void LfpLatencyChannelWorkers::perform(ChannelJob newJob, void *newContext, int newNumChannels)
+{
+    if (workers.empty() || newNumChannels <= 1)
+    {
+        newJob(newContext, 0, newNumChannels);
+        return;
+    }
+
+    // Ranges only become claimable once the job is in place
+    job = newJob;
+    context = newContext;
+    numChannels = newNumChannels;
+    finishedShares.store(0, std::memory_order_relaxed);
+    nextShare.store(0, std::memory_order_release);
+    for (auto &worker : workers)
+    {
+        worker->wake.signal();
+    }
+
+    // A worker that is slow to wake costs nothing, its range is done here instead
+    performUnclaimedShares();
+
+    // Only ranges a worker is already running are left
+    while (finishedShares.load(std::memory_order_acquire) < numShares)
+    {
+        std::this_thread::yield();
+    }
+}
+
+void LfpLatencyChannelWorkers::performUnclaimedShares()
+{
+    int share;
+    while ((share = nextShare.fetch_add(1, std::memory_order_acquire)) < numShares)
+    {
+        performShare(share);
+        finishedShares.fetch_add(1, std::memory_order_release);
+    }
+}
+
+void LfpLatencyChannelWorkers::performShare(int share)
+{
+    int startChannel = numChannels * share / numShares;
+    int endChannel = numChannels * (share + 1) / numShares;
+    if (endChannel > startChannel)
+    {
+        job(context, startChannel, endChannel);
+    }
+}
@@ -0,0 +1,94 @@
+/*
+    ------------------------------------------------------------------
+
+    This file is part of APTrack, a plugin for the Open-Ephys Gui
+
+    Copyright (C) 2019-2023 Eli Lilly and Company, University of Bristol, Open Ephys
+    Authors: Aidan Nickerson, Grace Stangroome, Merle Zhang, James O'Sullivan, Manuel Martinez
+
+    ------------------------------------------------------------------
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef LFPLATENCYCHANNELWORKERS_H_INCLUDED
+#define LFPLATENCYCHANNELWORKERS_H_INCLUDED
+
+#include <ProcessorHeaders.h>
+#include <atomic>
+#include <memory>
+#include <vector>
+
+/**
+    Small pool of threads that split per-channel work of the audio callback.
+
+    perform() splits the channels into one range per thread. The workers and the caller claim ranges
+    from a shared counter, so the caller does any range a worker has not woken up for, and only ever
+    waits on ranges a worker is already running. It returns once every range is done, so the caller
+    never sees a partially processed block.
+*/
+class LfpLatencyChannelWorkers
+{
+public:
+    /** Processes channels [startChannel, endChannel) */
+    typedef void (*ChannelJob)(void *context, int startChannel, int endChannel);
+
+    LfpLatencyChannelWorkers();
+    ~LfpLatencyChannelWorkers();
+
+    /** Starts numWorkers threads, stopping any running ones. Must not be called during perform(). */
+    void start(int numWorkers);
+
+    /** Stops all threads. Must not be called during perform(). */
+    void stop();
+
+    int getNumWorkers() const;
+
+    /** Runs job over numChannels channels, split between the calling thread and the workers */
+    void perform(ChannelJob job, void *context, int numChannels);
+
+private:
+    class Worker : public Thread
+    {
+    public:
+        Worker(LfpLatencyChannelWorkers &owner, int index);
+        void run() override;
+
+        WaitableEvent wake;
+
+    private:
+        LfpLatencyChannelWorkers &owner;
+    };
+
+    /** Runs one of the numShares channel ranges of the current job */
+    void performShare(int share);
+
+    /** Claims and runs channel ranges of the current job until none is left */
+    void performUnclaimedShares();
+
+    std::vector<std::unique_ptr<Worker>> workers;
+
+    // The current job, set before the workers are woken
+    ChannelJob job;
+    void *context;
+    int numChannels;
+    int numShares;                   // set by start(), one range per worker plus the caller's
+    std::atomic<int> nextShare;      // next range to claim, numShares or more once all are claimed
+    std::atomic<int> finishedShares; // ranges of the current job that are done
+
+    JUCE_DECLARE_NON_COPYABLE(LfpLatencyChannelWorkers);
+};
+
+#endif // LFPLATENCYCHANNELWORKERS_H_INCLUDED
@@ -0,0 +1,165 @@
+/*
+    ------------------------------------------------------------------
+
+    This file is part of APTrack, a plugin for the Open-Ephys Gui
+
+    Copyright (C) 2019-2023 Eli Lilly and Company, University of Bristol, Open Ephys
+    Authors: Aidan Nickerson, Grace Stangroome, Merle Zhang, James O'Sullivan, Manuel Martinez
+
+    ------------------------------------------------------------------
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include "LfpLatencyFilterBank.h"
+
+// Coefficients from the Audio EQ Cookbook (R. Bristow-Johnson)
+
+// Quality factor of a second order Butterworth section, 1 / sqrt(2)
+#define BUTTERWORTH_Q 0.70710678118654752
+
+BiquadCoefficients BiquadCoefficients::highPass(double sampleRate, double frequency)
+{
+    double w0 = MathConstants<double>::twoPi * frequency / sampleRate;
+    double alpha = std::sin(w0) / (2.0 * BUTTERWORTH_Q);
+    double cosw0 = std::cos(w0);
+    double a0 = 1.0 + alpha;
+
+    BiquadCoefficients c;
+    c.b0 = static_cast<float>((1.0 + cosw0) / 2.0 / a0);
+    c.b1 = static_cast<float>(-(1.0 + cosw0) / a0);
+    c.b2 = c.b0;
+    c.a1 = static_cast<float>(-2.0 * cosw0 / a0);
+    c.a2 = static_cast<float>((1.0 - alpha) / a0);
+    return c;
+}
+
+BiquadCoefficients BiquadCoefficients::lowPass(double sampleRate, double frequency)
+{
+    double w0 = MathConstants<double>::twoPi * frequency / sampleRate;
+    double alpha = std::sin(w0) / (2.0 * BUTTERWORTH_Q);
+    double cosw0 = std::cos(w0);
+    double a0 = 1.0 + alpha;
+
+    BiquadCoefficients c;
+    c.b0 = static_cast<float>((1.0 - cosw0) / 2.0 / a0);
+    c.b1 = static_cast<float>((1.0 - cosw0) / a0);
+    c.b2 = c.b0;
+    c.a1 = static_cast<float>(-2.0 * cosw0 / a0);
+    c.a2 = static_cast<float>((1.0 - alpha) / a0);
+    return c;
+}
+
+BiquadCoefficients BiquadCoefficients::notch(double sampleRate, double frequency, double q)
+{
+    double w0 = MathConstants<double>::twoPi * frequency / sampleRate;
+    double alpha = std::sin(w0) / (2.0 * q);
+    double cosw0 = std::cos(w0);
+    double a0 = 1.0 + alpha;
+
+    BiquadCoefficients c;
+    c.b0 = static_cast<float>(1.0 / a0);
+    c.b1 = static_cast<float>(-2.0 * cosw0 / a0);
+    c.b2 = c.b0;
+    c.a1 = c.b1;
+    c.a2 = static_cast<float>((1.0 - alpha) / a0);
+    return c;
+}
+
+LfpLatencyFilterBank::LfpLatencyFilterBank()
+    : numSections(0), numChannels(0)
+{
+}
+
+void LfpLatencyFilterBank::prepare(int newNumChannels)
+{
+    numChannels = jmax(0, newNumChannels);
+    state.assign(static_cast<size_t>(numChannels) * MAX_FILTER_SECTIONS * 2, 0.0f);
+}
+
+void LfpLatencyFilterBank::setSections(const BiquadCoefficients *newSections, int newNumSections)
+{
+    numSections = jlimit(0, MAX_FILTER_SECTIONS, newNumSections);
+    for (int s = 0; s < numSections; s++)
+    {
+        sections[s] = newSections[s];
+    }
+    reset();
+}
+
+int LfpLatencyFilterBank::getNumSections() const
+{
+    return numSections;
+}
+
+void LfpLatencyFilterBank::reset()
+{
+    std::fill(state.begin(), state.end(), 0.0f);
+}
+
+void LfpLatencyFilterBank::process(int firstChannel, int numLanes, const float *const *inputs, float (*outputs)[FILTER_CHUNK], int numSamples)
+{
+    numLanes = jlimit(0, jmin(FILTER_LANES, numChannels - firstChannel), numLanes);
+
+    // Gather the state of the lanes side by side, unused lanes run on zeros
+    float z1[MAX_FILTER_SECTIONS][FILTER_LANES] = {};
+    float z2[MAX_FILTER_SECTIONS][FILTER_LANES] = {};
+    for (int lane = 0; lane < numLanes; lane++)
+    {
+        const float *channelState = state.data() + static_cast<size_t>(firstChannel + lane) * MAX_FILTER_SECTIONS * 2;
+        for (int s = 0; s < numSections; s++)
+        {
+            z1[s][lane] = channelState[2 * s];
+            z2[s][lane] = channelState[2 * s + 1];
+        }
+    }
+
+    for (int n = 0; n < numSamples; n++)
+    {
+        float x[FILTER_LANES] = {};
+        for (int lane = 0; lane < numLanes; lane++)
+        {
+            x[lane] = inputs[lane][n];
+        }
+
+        // Transposed direct form II, each statement is one operation across all lanes
+        for (int s = 0; s < numSections; s++)
+        {
+            const auto &c = sections[s];
+            for (int lane = 0; lane < FILTER_LANES; lane++)
+            {
+                float y = c.b0 * x[lane] + z1[s][lane];
+                z1[s][lane] = c.b1 * x[lane] - c.a1 * y + z2[s][lane];
+                z2[s][lane] = c.b2 * x[lane] - c.a2 * y;
+                x[lane] = y;
+            }
+        }
+
+        for (int lane = 0; lane < numLanes; lane++)
+        {
+            outputs[lane][n] = x[lane];
+        }
+    }
+
+    for (int lane = 0; lane < numLanes; lane++)
+    {
+        float *channelState = state.data() + static_cast<size_t>(firstChannel + lane) * MAX_FILTER_SECTIONS * 2;
+        for (int s = 0; s < numSections; s++)
+        {
+            channelState[2 * s] = z1[s][lane];
+            channelState[2 * s + 1] = z2[s][lane];
+        }
+    }
+}
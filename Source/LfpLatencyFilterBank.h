@@ -0,0 +1,95 @@
+/*
+    ------------------------------------------------------------------
+
+    This file is part of APTrack, a plugin for the Open-Ephys Gui
+
+    Copyright (C) 2019-2023 Eli Lilly and Company, University of Bristol, Open Ephys
+    Authors: Aidan Nickerson, Grace Stangroome, Merle Zhang, James O'Sullivan, Manuel Martinez
+
+    ------------------------------------------------------------------
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef LFPLATENCYFILTERBANK_H_INCLUDED
+#define LFPLATENCYFILTERBANK_H_INCLUDED
+
+#include <ProcessorHeaders.h>
+#include <vector>
+
+// Channels filtered side by side, one SIMD lane each
+#define FILTER_LANES 8
+
+// Samples filtered per pass, small enough to stay on the stack and in L1
+#define FILTER_CHUNK 256
+
+// High-pass, low-pass and notch
+#define MAX_FILTER_SECTIONS 3
+
+/** Coefficients of one biquad section, normalised so a0 = 1 */
+struct BiquadCoefficients
+{
+    float b0 = 1, b1 = 0, b2 = 0;
+    float a1 = 0, a2 = 0;
+
+    /** Second order Butterworth high-pass */
+    static BiquadCoefficients highPass(double sampleRate, double frequency);
+
+    /** Second order Butterworth low-pass */
+    static BiquadCoefficients lowPass(double sampleRate, double frequency);
+
+    /** Notch of quality q, for line noise */
+    static BiquadCoefficients notch(double sampleRate, double frequency, double q);
+};
+
+/**
+    Cascade of biquad sections applied to every cached channel, with independent state per channel.
+
+    Channels are filtered FILTER_LANES at a time with the lanes laid out side by side, so each step of the
+    recursion is one vector operation across channels. Different channel ranges may be filtered in parallel.
+*/
+class LfpLatencyFilterBank
+{
+public:
+    LfpLatencyFilterBank();
+
+    /** Allocates state for numChannels channels and clears it. Must not be called while the audio thread is filtering. */
+    void prepare(int numChannels);
+
+    /** Replaces the sections and clears the state. Audio thread only. */
+    void setSections(const BiquadCoefficients *sections, int numSections);
+
+    int getNumSections() const;
+
+    /** Clears the state of every channel */
+    void reset();
+
+    /**
+     Filters numSamples samples of numLanes consecutive channels starting at firstChannel
+     - inputs: one pointer per lane, numLanes pointers
+     - outputs: FILTER_LANES rows of FILTER_CHUNK samples, numSamples must not exceed FILTER_CHUNK
+     */
+    void process(int firstChannel, int numLanes, const float *const *inputs, float (*outputs)[FILTER_CHUNK], int numSamples);
+
+private:
+    BiquadCoefficients sections[MAX_FILTER_SECTIONS];
+    int numSections;
+    int numChannels;
+    std::vector<float> state; // two delay elements per section per channel
+
+    JUCE_DECLARE_NON_COPYABLE(LfpLatencyFilterBank);
+};
+
+#endif // LFPLATENCYFILTERBANK_H_INCLUDED
@@ -0,0 +1,106 @@
+/*
+    ------------------------------------------------------------------
+
+    This file is part of APTrack, a plugin for the Open-Ephys Gui
+
+    Copyright (C) 2019-2023 Eli Lilly and Company, University of Bristol, Open Ephys
+    Authors: Aidan Nickerson, Grace Stangroome, Merle Zhang, James O'Sullivan, Manuel Martinez
+
+    ------------------------------------------------------------------
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include "LfpLatencyFiringHistory.h"
+
+LfpLatencyFiringHistory::LfpLatencyFiringHistory()
+    : window(DEFAULT_FIRING_WINDOW)
+{
+    clear();
+}
+
+void LfpLatencyFiringHistory::setWindow(int numStimuli)
+{
+    numStimuli = jlimit(1, MAX_FIRING_WINDOW, numStimuli);
+    if (numStimuli != window)
+    {
+        window = numStimuli;
+        clear();
+    }
+}
+
+int LfpLatencyFiringHistory::getWindow() const
+{
+    return window;
+}
+
+void LfpLatencyFiringHistory::push(bool fired, float stimulusVoltage)
+{
+    int position = oldest + numStimuli;
+    if (numStimuli == window)
+    {
+        // The oldest stimulus leaves the window and its slot takes the new one
+        position = oldest;
+        numFired -= static_cast<int>((bits[position >> 6] >> (position & 63)) & 1);
+        voltageStepSum -= voltageSteps[position];
+        oldest = oldest + 1 == window ? 0 : oldest + 1;
+    }
+    else
+    {
+        numStimuli++;
+        position = position >= window ? position - window : position;
+    }
+
+    uint64 mask = uint64(1) << (position & 63);
+    bits[position >> 6] = fired ? bits[position >> 6] | mask : bits[position >> 6] & ~mask;
+    numFired += fired ? 1 : 0;
+    uint16 step = static_cast<uint16>(roundToInt(jlimit(0.0f, 1.0f, stimulusVoltage / FIRING_VOLTAGE_RANGE) * 65535.0f));
+    voltageSteps[position] = step;
+    voltageStepSum += step;
+}
+
+void LfpLatencyFiringHistory::clear()
+{
+    bits.fill(0);
+    oldest = 0;
+    numStimuli = 0;
+    numFired = 0;
+    voltageStepSum = 0;
+}
+
+bool LfpLatencyFiringHistory::isFull() const
+{
+    return numStimuli == window;
+}
+
+int LfpLatencyFiringHistory::getNumStimuli() const
+{
+    return numStimuli;
+}
+
+int LfpLatencyFiringHistory::getNumFired() const
+{
+    return numFired;
+}
+
+float LfpLatencyFiringHistory::getFiringProbability() const
+{
+    return numStimuli > 0 ? static_cast<float>(numFired) / numStimuli : 0.0f;
+}
+
+float LfpLatencyFiringHistory::getMeanVoltage() const
+{
+    return numStimuli > 0 ? static_cast<float>(static_cast<double>(voltageStepSum) / numStimuli * FIRING_VOLTAGE_RANGE / 65535.0) : 0.0f;
+}
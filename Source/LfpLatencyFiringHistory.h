@@ -0,0 +1,85 @@
+/*
+    ------------------------------------------------------------------
+
+    This file is part of APTrack, a plugin for the Open-Ephys Gui
+
+    Copyright (C) 2019-2023 Eli Lilly and Company, University of Bristol, Open Ephys
+    Authors: Aidan Nickerson, Grace Stangroome, Merle Zhang, James O'Sullivan, Manuel Martinez
+
+    ------------------------------------------------------------------
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef LFPLATENCYFIRINGHISTORY_H_INCLUDED
+#define LFPLATENCYFIRINGHISTORY_H_INCLUDED
+
+#include <ProcessorHeaders.h>
+#include <array>
+
+#define MAX_FIRING_WINDOW 4096    // most stimuli a firing probability can be taken over
+#define DEFAULT_FIRING_WINDOW 10
+#define FIRING_VOLTAGE_RANGE 10.0f // stimulus voltages are kept as 16-bit steps over [0, range], finer than the PulsePal output
+
+/**
+    Whether a spike group fired for each of its most recent stimuli, with the voltage of each stimulus.
+
+    The outcomes are kept as a ring of bits with a running count of set bits, and the voltages with a
+    running sum, so recording a stimulus and reading the firing probability or the mean voltage cost the
+    same whatever the window length. Storage is fixed, so the audio thread never allocates. Voltages are
+    kept as 16-bit steps with an exact integer sum, which halves the ring every spike group carries.
+*/
+class LfpLatencyFiringHistory
+{
+public:
+    LfpLatencyFiringHistory();
+
+    /** Changes the number of stimuli in the window, forgetting the history if it differs */
+    void setWindow(int numStimuli);
+
+    int getWindow() const;
+
+    /** Records the outcome of a stimulus, dropping the oldest once the window is full */
+    void push(bool fired, float stimulusVoltage);
+
+    /** Forgets every stimulus */
+    void clear();
+
+    /** Returns true once the window holds as many stimuli as it is long */
+    bool isFull() const;
+
+    /** Returns the number of stimuli recorded, up to the window length */
+    int getNumStimuli() const;
+
+    /** Returns the number of recorded stimuli the group fired for */
+    int getNumFired() const;
+
+    /** Returns the fraction of the recorded stimuli the group fired for, 0 before the first one */
+    float getFiringProbability() const;
+
+    /** Returns the mean voltage of the recorded stimuli */
+    float getMeanVoltage() const;
+
+private:
+    std::array<uint64, MAX_FIRING_WINDOW / 64> bits;
+    std::array<uint16, MAX_FIRING_WINDOW> voltageSteps;
+    int window;
+    int oldest; // position of the oldest stimulus in the ring
+    int numStimuli;
+    int numFired;
+    int64 voltageStepSum;
+};
+
+#endif // LFPLATENCYFIRINGHISTORY_H_INCLUDED
@@ -0,0 +1,248 @@
+/*
+    ------------------------------------------------------------------
+
+    This file is part of APTrack, a plugin for the Open-Ephys Gui
+
+    Copyright (C) 2019-2023 Eli Lilly and Company, University of Bristol, Open Ephys
+    Authors: Aidan Nickerson, Grace Stangroome, Merle Zhang, James O'Sullivan, Manuel Martinez
+
+    ------------------------------------------------------------------
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include "LfpLatencyGroupDiscovery.h"
+#include "LfpLatencyProcessor.h"
+
+LfpLatencyGroupDiscovery::LfpLatencyGroupDiscovery(LfpLatencyProcessor &p)
+    : Thread("APTrack group discovery"), processor(p), windowPeaks(DISCOVERY_WINDOW_TRACKS), numWindowTracks(0), nextWindowTrack(0), lastThreshold(0),
+      samplesPerTrack(0), sampleRate(0), dataChannel(-1), lastTrack(-1), binSamples(1), blankingSamples(0), separationSamples(1)
+{
+    for (auto &peaks : windowPeaks)
+    {
+        peaks.reserve(DISCOVERY_MAX_PEAKS);
+    }
+}
+
+LfpLatencyGroupDiscovery::~LfpLatencyGroupDiscovery()
+{
+    stopThread(1000);
+}
+
+void LfpLatencyGroupDiscovery::start()
+{
+    stop();
+    samplesPerTrack = 0;
+    dataChannel = -1;
+    startThread();
+}
+
+void LfpLatencyGroupDiscovery::stop()
+{
+    stopThread(1000);
+}
+
+std::vector<SpikeGroupSuggestion> LfpLatencyGroupDiscovery::getSuggestions() const
+{
+    const ScopedLock lock(suggestionLock);
+    return suggestions;
+}
+
+void LfpLatencyGroupDiscovery::run()
+{
+    while (!threadShouldExit())
+    {
+        wait(50);
+
+        // Latencies of another channel or track length do not belong in the same histogram
+        int newSamplesPerTrack = processor.getSamplesPerTrack();
+        float newSampleRate = processor.getDataSampleRate();
+        int newDataChannel = processor.getParameterInt(2);
+        if (newSamplesPerTrack != samplesPerTrack || newSampleRate != sampleRate || newDataChannel != dataChannel)
+        {
+            reset(newSamplesPerTrack, newSampleRate);
+            dataChannel = newDataChannel;
+            lastTrack = processor.getLastPublishedTrack();
+        }
+
+        // After a pause only the tracks that still fit in the window matter
+        int64 newestTrack = processor.getLastPublishedTrack();
+        bool added = false;
+        for (int64 track = std::max(lastTrack + 1, newestTrack - DISCOVERY_WINDOW_TRACKS + 1); track <= newestTrack && !threadShouldExit(); track++)
+        {
+            int numValid = processor.readPublishedTrack(track, 0, samplesPerTrack, trackBuffer.data());
+            if (numValid > 0)
+            {
+                addTrack(trackBuffer.data(), numValid);
+                added = true;
+            }
+        }
+        lastTrack = std::max(lastTrack, newestTrack);
+        if (added)
+        {
+            findClusters();
+        }
+    }
+}
+
+void LfpLatencyGroupDiscovery::reset(int newSamplesPerTrack, float newSampleRate)
+{
+    samplesPerTrack = jmax(0, newSamplesPerTrack);
+    sampleRate = newSampleRate;
+    trackBuffer.assign(samplesPerTrack, 0.0f);
+    for (auto &peaks : windowPeaks)
+    {
+        peaks.clear();
+    }
+    numWindowTracks = 0;
+    nextWindowTrack = 0;
+
+    float samplesPerMs = sampleRate / 1000.0f;
+    binSamples = jmax(1, roundToInt(DISCOVERY_BIN_MS * samplesPerMs));
+    blankingSamples = roundToInt(DISCOVERY_BLANKING_MS * samplesPerMs);
+    separationSamples = jmax(1, roundToInt(DISCOVERY_PEAK_SEPARATION_MS * samplesPerMs));
+    int numBins = samplesPerTrack / binSamples + 1;
+    binCounts.assign(numBins, 0);
+    binLatencySums.assign(numBins, 0.0);
+    binLatencySquares.assign(numBins, 0.0);
+    binValueSums.assign(numBins, 0.0);
+
+    const ScopedLock lock(suggestionLock);
+    suggestions.clear();
+}
+
+void LfpLatencyGroupDiscovery::addTrack(const float *track, int numSamples)
+{
+    // The oldest track makes room for this one
+    auto &peaks = windowPeaks[nextWindowTrack];
+    if (numWindowTracks == DISCOVERY_WINDOW_TRACKS)
+    {
+        accumulate(peaks, -1);
+    }
+    else
+    {
+        numWindowTracks++;
+    }
+    nextWindowTrack = (nextWindowTrack + 1) % DISCOVERY_WINDOW_TRACKS;
+    peaks.clear();
+
+    // Candidates are the maxima of the runs above threshold, runs closer than the separation count once
+    lastThreshold = DISCOVERY_NOISE_MULTIPLIER * NOISE_MEDIAN_TO_SIGMA * LfpLatencyNoiseEstimator::estimateMedian(track, numSamples);
+    int lastPeakSample = -separationSamples;
+    for (int i = blankingSamples; i < numSamples && lastThreshold > 0; i++)
+    {
+        if (track[i] < lastThreshold)
+        {
+            continue;
+        }
+        int peakSample = i;
+        for (; i < numSamples && track[i] >= lastThreshold; i++)
+        {
+            peakSample = track[i] > track[peakSample] ? i : peakSample;
+        }
+        if (!peaks.empty() && peakSample - lastPeakSample < separationSamples)
+        {
+            if (track[peakSample] <= peaks.back().value)
+            {
+                continue;
+            }
+            peaks.pop_back();
+        }
+        if (static_cast<int>(peaks.size()) == DISCOVERY_MAX_PEAKS)
+        {
+            break;
+        }
+        Peak peak;
+        peak.latency = LfpLatencySpikeDetector::refinePeakLatency(track, peakSample, 0, numSamples);
+        peak.bin = jlimit(0, static_cast<int>(binCounts.size()) - 1, peakSample / binSamples);
+        peak.value = track[peakSample];
+        peaks.push_back(peak);
+        lastPeakSample = peakSample;
+    }
+    accumulate(peaks, 1);
+}
+
+void LfpLatencyGroupDiscovery::accumulate(const std::vector<Peak> &peaks, int sign)
+{
+    for (const auto &peak : peaks)
+    {
+        binCounts[peak.bin] += sign;
+        binLatencySums[peak.bin] += sign * peak.latency;
+        binLatencySquares[peak.bin] += sign * peak.latency * peak.latency;
+        binValueSums[peak.bin] += sign * peak.value;
+    }
+}
+
+void LfpLatencyGroupDiscovery::findClusters()
+{
+    std::vector<SpikeGroupSuggestion> found;
+    int numBins = static_cast<int>(binCounts.size());
+    auto density = [this, numBins](int bin)
+    {
+        int count = 0;
+        for (int b = jmax(0, bin - 1); b <= jmin(numBins - 1, bin + 1); b++)
+        {
+            count += binCounts[b];
+        }
+        return count;
+    };
+
+    // Clusters are the maxima of the histogram smoothed over three bins that fire often enough
+    float maxJitter = DISCOVERY_MAX_JITTER_MS * sampleRate / 1000.0f;
+    int minCount = static_cast<int>(std::ceil(DISCOVERY_MIN_FIRING * numWindowTracks));
+    for (int bin = 0; bin < numBins && numWindowTracks >= DISCOVERY_MIN_TRACKS; bin++)
+    {
+        int count = density(bin);
+        if (count < minCount || count < density(bin - 1) || count <= density(bin + 1))
+        {
+            continue;
+        }
+        double latencySum = 0, latencySquares = 0, valueSum = 0;
+        for (int b = jmax(0, bin - 1); b <= jmin(numBins - 1, bin + 1); b++)
+        {
+            latencySum += binLatencySums[b];
+            latencySquares += binLatencySquares[b];
+            valueSum += binValueSums[b];
+        }
+        SpikeGroupSuggestion suggestion;
+        suggestion.latency = static_cast<float>(latencySum / count);
+        suggestion.jitter = static_cast<float>(std::sqrt(jmax(0.0, latencySquares / count - suggestion.latency * static_cast<double>(suggestion.latency))));
+        if (suggestion.jitter > maxJitter)
+        {
+            continue;
+        }
+        suggestion.firingFraction = jmin(1.0f, static_cast<float>(count) / numWindowTracks);
+        suggestion.peakValue = static_cast<float>(valueSum / count);
+        suggestion.threshold = lastThreshold;
+        found.push_back(suggestion);
+    }
+
+    // Strongest first, dropping weaker maxima that share a bin with a stronger one
+    std::sort(found.begin(), found.end(), [](const SpikeGroupSuggestion &a, const SpikeGroupSuggestion &b)
+              { return a.firingFraction != b.firingFraction ? a.firingFraction > b.firingFraction : a.peakValue > b.peakValue; });
+    std::vector<SpikeGroupSuggestion> kept;
+    for (const auto &suggestion : found)
+    {
+        bool separate = std::none_of(kept.begin(), kept.end(), [&](const SpikeGroupSuggestion &k)
+                                     { return std::abs(k.latency - suggestion.latency) < 3 * binSamples; });
+        if (separate && kept.size() < DISCOVERY_MAX_SUGGESTIONS)
+        {
+            kept.push_back(suggestion);
+        }
+    }
+
+    const ScopedLock lock(suggestionLock);
+    suggestions.swap(kept);
+}
@@ -0,0 +1,129 @@
+/*
+    ------------------------------------------------------------------
+
+    This file is part of APTrack, a plugin for the Open-Ephys Gui
+
+    Copyright (C) 2019-2023 Eli Lilly and Company, University of Bristol, Open Ephys
+    Authors: Aidan Nickerson, Grace Stangroome, Merle Zhang, James O'Sullivan, Manuel Martinez
+
+    ------------------------------------------------------------------
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef LFPLATENCYGROUPDISCOVERY_H_INCLUDED
+#define LFPLATENCYGROUPDISCOVERY_H_INCLUDED
+
+#include <ProcessorHeaders.h>
+#include <vector>
+
+// Candidate peaks of a finished track
+#define DISCOVERY_NOISE_MULTIPLIER 6.0f    // candidate peaks rise this many noise standard deviations above the baseline
+#define DISCOVERY_BLANKING_MS 1.0f         // start of the track left to the stimulus artifact
+#define DISCOVERY_PEAK_SEPARATION_MS 0.5f  // closer peaks are merged into the larger one
+#define DISCOVERY_MAX_PEAKS 64             // candidate peaks kept per track
+
+// Latency clustering over the most recent tracks
+#define DISCOVERY_WINDOW_TRACKS 20     // tracks clustered together
+#define DISCOVERY_MIN_TRACKS 10        // tracks needed before anything is suggested
+#define DISCOVERY_BIN_MS 0.1f          // latency histogram resolution
+#define DISCOVERY_MIN_FIRING 0.5f      // fraction of the tracks a cluster must fire in
+#define DISCOVERY_MAX_JITTER_MS 0.25f  // latency spread of a constant-latency cluster
+#define DISCOVERY_MAX_SUGGESTIONS 8
+
+class LfpLatencyProcessor;
+
+/** A stable constant-latency cluster of peaks, offered as a new spike group */
+struct SpikeGroupSuggestion
+{
+    float latency;        // mean latency in data stream samples, with sub-sample precision
+    float jitter;         // standard deviation of the latency in samples
+    float firingFraction; // fraction of the clustered tracks with a peak in the cluster
+    float peakValue;      // mean peak value
+    float threshold;      // candidate peak threshold of the most recent track
+};
+
+/**
+    Background search for spike groups nobody has added yet.
+
+    A thread picks up every track the processor publishes on the displayed data channel, extracts the
+    peaks that stand out of its noise and adds their latencies to a histogram covering the most recent
+    tracks. Each track adds and removes only its own peaks, so the cost per stimulus is one pass over the
+    track. Dense runs of the histogram with little latency spread are the suggestions, strongest first.
+*/
+class LfpLatencyGroupDiscovery : public Thread
+{
+public:
+    LfpLatencyGroupDiscovery(LfpLatencyProcessor &processor);
+    ~LfpLatencyGroupDiscovery();
+
+    /** Starts the discovery thread, forgetting earlier tracks. Call before acquisition starts. */
+    void start();
+
+    /** Stops the discovery thread. Call after acquisition stops. */
+    void stop();
+
+    /** Returns the current suggestions, strongest first */
+    std::vector<SpikeGroupSuggestion> getSuggestions() const;
+
+    void run() override;
+
+private:
+    struct Peak
+    {
+        int bin;
+        float latency;
+        float value;
+    };
+
+    /** Restarts clustering for a new track length or sample rate */
+    void reset(int samplesPerTrack, float sampleRate);
+
+    /** Finds the candidate peaks of a track and replaces the oldest track of the window with them */
+    void addTrack(const float *track, int numSamples);
+
+    /** Adds (sign 1) or removes (sign -1) the peaks of one track from the histogram */
+    void accumulate(const std::vector<Peak> &peaks, int sign);
+
+    /** Rebuilds the suggestions from the histogram */
+    void findClusters();
+
+    LfpLatencyProcessor &processor;
+
+    std::vector<float> trackBuffer;
+    std::vector<std::vector<Peak>> windowPeaks; // candidate peaks of the most recent tracks, oldest overwritten first
+    int numWindowTracks;
+    int nextWindowTrack;
+    std::vector<int> binCounts; // tracks with a peak in each latency bin
+    std::vector<double> binLatencySums;
+    std::vector<double> binLatencySquares;
+    std::vector<double> binValueSums;
+    float lastThreshold;
+
+    int samplesPerTrack;
+    float sampleRate;
+    int dataChannel;
+    int64 lastTrack;
+    int binSamples;
+    int blankingSamples;
+    int separationSamples;
+
+    CriticalSection suggestionLock;
+    std::vector<SpikeGroupSuggestion> suggestions;
+
+    JUCE_DECLARE_NON_COPYABLE(LfpLatencyGroupDiscovery);
+};
+
+#endif // LFPLATENCYGROUPDISCOVERY_H_INCLUDED
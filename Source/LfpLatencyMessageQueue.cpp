@@ -0,0 +1,97 @@
+/*
+    ------------------------------------------------------------------
+
+    This file is part of APTrack, a plugin for the Open-Ephys Gui
+
+    Copyright (C) 2019-2023 Eli Lilly and Company, University of Bristol, Open Ephys
+    Authors: Aidan Nickerson, Grace Stangroome, Merle Zhang, James O'Sullivan, Manuel Martinez
+
+    ------------------------------------------------------------------
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include "LfpLatencyMessageQueue.h"
+#include <algorithm>
+#include <cstring>
+
+static_assert((MESSAGE_QUEUE_CAPACITY & (MESSAGE_QUEUE_CAPACITY - 1)) == 0, "MESSAGE_QUEUE_CAPACITY must be a power of two");
+
+LfpLatencyMessageQueue::LfpLatencyMessageQueue()
+    : enqueuePosition(0), dequeuePosition(0), numDropped(0)
+{
+    // A slot is free for the producer whose position equals its sequence
+    for (size_t i = 0; i < MESSAGE_QUEUE_CAPACITY; i++)
+    {
+        slots[i].sequence.store(i, std::memory_order_relaxed);
+    }
+}
+
+bool LfpLatencyMessageQueue::push(int64 sampleNumber, const std::string &text)
+{
+    Slot *slot;
+    size_t position = enqueuePosition.load(std::memory_order_relaxed);
+    while (true)
+    {
+        slot = &slots[position & (MESSAGE_QUEUE_CAPACITY - 1)];
+        size_t sequence = slot->sequence.load(std::memory_order_acquire);
+        intptr_t difference = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(position);
+        if (difference == 0)
+        {
+            // Free, claim it unless another producer got there first
+            if (enqueuePosition.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
+            {
+                break;
+            }
+        }
+        else if (difference < 0)
+        {
+            // The consumer has not freed this slot yet
+            numDropped++;
+            return false;
+        }
+        else
+        {
+            position = enqueuePosition.load(std::memory_order_relaxed);
+        }
+    }
+
+    slot->message.sampleNumber = sampleNumber;
+    size_t length = std::min(text.size(), static_cast<size_t>(MESSAGE_MAX_LENGTH - 1));
+    std::memcpy(slot->message.text, text.data(), length);
+    slot->message.text[length] = '\0';
+    slot->sequence.store(position + 1, std::memory_order_release);
+    return true;
+}
+
+bool LfpLatencyMessageQueue::pop(QueuedMessage &dest)
+{
+    Slot &slot = slots[dequeuePosition & (MESSAGE_QUEUE_CAPACITY - 1)];
+    if (slot.sequence.load(std::memory_order_acquire) != dequeuePosition + 1)
+    {
+        // Empty, or the producer of the oldest slot is still writing it
+        return false;
+    }
+
+    dest = slot.message;
+    slot.sequence.store(dequeuePosition + MESSAGE_QUEUE_CAPACITY, std::memory_order_release);
+    dequeuePosition++;
+    return true;
+}
+
+int LfpLatencyMessageQueue::getNumDropped() const
+{
+    return numDropped.load();
+}
@@ -0,0 +1,81 @@
+/*
+    ------------------------------------------------------------------
+
+    This file is part of APTrack, a plugin for the Open-Ephys Gui
+
+    Copyright (C) 2019-2023 Eli Lilly and Company, University of Bristol, Open Ephys
+    Authors: Aidan Nickerson, Grace Stangroome, Merle Zhang, James O'Sullivan, Manuel Martinez
+
+    ------------------------------------------------------------------
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef LFPLATENCYMESSAGEQUEUE_H_INCLUDED
+#define LFPLATENCYMESSAGEQUEUE_H_INCLUDED
+
+#include <ProcessorHeaders.h>
+#include <atomic>
+#include <string>
+
+// Number of message slots, must be a power of two
+#define MESSAGE_QUEUE_CAPACITY 256
+
+// Longest message kept, longer messages are truncated
+#define MESSAGE_MAX_LENGTH 256
+
+/** A message copied into a queue slot, stamped with the sample number current when it was queued */
+struct QueuedMessage
+{
+    int64 sampleNumber;
+    char text[MESSAGE_MAX_LENGTH];
+};
+
+/**
+    Bounded multi-producer, single-consumer queue of preallocated message slots.
+
+    Any thread may push, only the audio thread pops. Neither side blocks or allocates: each slot carries a
+    sequence number that tells producers when it is free and the consumer when it has been written.
+*/
+class LfpLatencyMessageQueue
+{
+public:
+    LfpLatencyMessageQueue();
+
+    /** Copies a message into a free slot. Returns false, dropping the message, if the queue is full. */
+    bool push(int64 sampleNumber, const std::string &text);
+
+    /** Copies the oldest message into dest and frees its slot. Returns false if the queue is empty. Consumer only. */
+    bool pop(QueuedMessage &dest);
+
+    /** Returns the number of messages dropped because the queue was full */
+    int getNumDropped() const;
+
+private:
+    struct alignas(64) Slot
+    {
+        std::atomic<size_t> sequence;
+        QueuedMessage message;
+    };
+
+    Slot slots[MESSAGE_QUEUE_CAPACITY];
+    alignas(64) std::atomic<size_t> enqueuePosition; // shared by the producers
+    alignas(64) size_t dequeuePosition;              // consumer only
+    std::atomic<int> numDropped;
+
+    JUCE_DECLARE_NON_COPYABLE(LfpLatencyMessageQueue);
+};
+
+#endif // LFPLATENCYMESSAGEQUEUE_H_INCLUDED
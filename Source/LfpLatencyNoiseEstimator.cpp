@@ -0,0 +1,127 @@
+/*
+    ------------------------------------------------------------------
+
+    This file is part of APTrack, a plugin for the Open-Ephys Gui
+
+    Copyright (C) 2019-2023 Eli Lilly and Company, University of Bristol, Open Ephys
+    Authors: Aidan Nickerson, Grace Stangroome, Merle Zhang, James O'Sullivan, Manuel Martinez
+
+    ------------------------------------------------------------------
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include "LfpLatencyNoiseEstimator.h"
+
+LfpLatencyNoiseEstimator::LfpLatencyNoiseEstimator()
+{
+}
+
+void LfpLatencyNoiseEstimator::allocate(int numChannels)
+{
+    noise.assign(jmax(0, numChannels), 0.0f);
+}
+
+void LfpLatencyNoiseEstimator::reset()
+{
+    std::fill(noise.begin(), noise.end(), 0.0f);
+}
+
+void LfpLatencyNoiseEstimator::addTrack(int channel, const float *baseline, int numSamples)
+{
+    if (channel < 0 || channel >= static_cast<int>(noise.size()) || numSamples <= 0)
+    {
+        return;
+    }
+    float trackNoise = NOISE_MEDIAN_TO_SIGMA * estimateMedian(baseline, numSamples);
+    float &level = noise[channel];
+    level = level > 0 ? level + NOISE_SMOOTHING * (trackNoise - level) : trackNoise;
+}
+
+float LfpLatencyNoiseEstimator::getNoise(int channel) const
+{
+    return channel >= 0 && channel < static_cast<int>(noise.size()) ? noise[channel] : 0.0f;
+}
+
+float LfpLatencyNoiseEstimator::estimateMedian(const float *samples, int numSamples)
+{
+    // Marker heights q, actual positions n and desired positions np of the minimum, quartiles, median and maximum
+    float q[5];
+    int numInitial = jmin(5, numSamples);
+    std::copy(samples, samples + numInitial, q);
+    std::sort(q, q + numInitial);
+    if (numSamples < 5)
+    {
+        return numSamples > 0 ? q[(numSamples - 1) / 2] : 0.0f;
+    }
+    int n[5] = {0, 1, 2, 3, 4};
+    float np[5] = {0.0f, 1.0f, 2.0f, 3.0f, 4.0f};
+    const float dn[5] = {0.0f, 0.25f, 0.5f, 0.75f, 1.0f};
+
+    for (int j = 5; j < numSamples; j++)
+    {
+        float x = samples[j];
+
+        // Find the cell holding x, stretching the extremes if it falls outside
+        int k;
+        if (x < q[0])
+        {
+            q[0] = x;
+            k = 0;
+        }
+        else if (x >= q[4])
+        {
+            q[4] = x;
+            k = 3;
+        }
+        else
+        {
+            k = 0;
+            while (x >= q[k + 1])
+            {
+                k++;
+            }
+        }
+        for (int i = k + 1; i < 5; i++)
+        {
+            n[i]++;
+        }
+        for (int i = 0; i < 5; i++)
+        {
+            np[i] += dn[i];
+        }
+
+        // Move the middle markers towards their desired positions, piecewise-parabolic where that keeps them ordered
+        for (int i = 1; i < 4; i++)
+        {
+            float d = np[i] - n[i];
+            if ((d >= 1.0f && n[i + 1] - n[i] > 1) || (d <= -1.0f && n[i - 1] - n[i] < -1))
+            {
+                int step = d > 0 ? 1 : -1;
+                float parabolic = q[i] + static_cast<float>(step) / (n[i + 1] - n[i - 1]) * ((n[i] - n[i - 1] + step) * (q[i + 1] - q[i]) / (n[i + 1] - n[i]) + (n[i + 1] - n[i] - step) * (q[i] - q[i - 1]) / (n[i] - n[i - 1]));
+                if (q[i - 1] < parabolic && parabolic < q[i + 1])
+                {
+                    q[i] = parabolic;
+                }
+                else
+                {
+                    q[i] += step * (q[i + step] - q[i]) / (n[i + step] - n[i]);
+                }
+                n[i] += step;
+            }
+        }
+    }
+    return q[2];
+}
@@ -0,0 +1,70 @@
+/*
+    ------------------------------------------------------------------
+
+    This file is part of APTrack, a plugin for the Open-Ephys Gui
+
+    Copyright (C) 2019-2023 Eli Lilly and Company, University of Bristol, Open Ephys
+    Authors: Aidan Nickerson, Grace Stangroome, Merle Zhang, James O'Sullivan, Manuel Martinez
+
+    ------------------------------------------------------------------
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef LFPLATENCYNOISEESTIMATOR_H_INCLUDED
+#define LFPLATENCYNOISEESTIMATOR_H_INCLUDED
+
+#include <ProcessorHeaders.h>
+#include <vector>
+
+#define NOISE_MEDIAN_TO_SIGMA 1.4826f // sigma of gaussian noise from the median of its absolute value
+#define NOISE_SMOOTHING 0.1f          // weight of the newest track in the smoothed noise level
+#define NOISE_MIN_BASELINE 32         // fewest pre-stimulus samples worth estimating the noise from
+
+/**
+    Streaming estimate of the noise level of every cache channel.
+
+    The median of the rectified baseline of each track is found in a single pass with the P-square
+    algorithm, which keeps five markers instead of sorting the track, and scaled to a standard deviation
+    as for the median absolute deviation. The per-track estimates are smoothed over tracks so the noise
+    level follows slow drift of the electrode without jumping on a single noisy track.
+*/
+class LfpLatencyNoiseEstimator
+{
+public:
+    LfpLatencyNoiseEstimator();
+
+    /** Allocates the channels and forgets the noise levels. Must not be called during addTrack(). */
+    void allocate(int numChannels);
+
+    /** Forgets the noise levels */
+    void reset();
+
+    /** Adds the rectified baseline of one track of a channel. Different channels may be added from different threads. */
+    void addTrack(int channel, const float *baseline, int numSamples);
+
+    /** Returns the smoothed noise level of a channel, 0 until a track has been added */
+    float getNoise(int channel) const;
+
+    /** Returns the median of samples in a single pass without reordering them */
+    static float estimateMedian(const float *samples, int numSamples);
+
+private:
+    std::vector<float> noise;
+
+    JUCE_DECLARE_NON_COPYABLE(LfpLatencyNoiseEstimator);
+};
+
+#endif // LFPLATENCYNOISEESTIMATOR_H_INCLUDED
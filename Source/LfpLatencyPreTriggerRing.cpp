@@ -0,0 +1,99 @@
+/*
+    ------------------------------------------------------------------
+
+    This file is part of APTrack, a plugin for the Open-Ephys Gui
+
+    Copyright (C) 2019-2023 Eli Lilly and Company, University of Bristol, Open Ephys
+    Authors: Aidan Nickerson, Grace Stangroome, Merle Zhang, James O'Sullivan, Manuel Martinez
+
+    ------------------------------------------------------------------
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include "LfpLatencyPreTriggerRing.h"
+
+LfpLatencyPreTriggerRing::LfpLatencyPreTriggerRing()
+    : numChannels(0), capacity(0), writePosition(0), numAvailable(0)
+{
+}
+
+void LfpLatencyPreTriggerRing::allocate(int newNumChannels, int newCapacity)
+{
+    numChannels = jmax(0, newNumChannels);
+    capacity = jmax(0, newCapacity);
+    samples.assign(static_cast<size_t>(numChannels) * capacity, 0.0f);
+    reset();
+}
+
+int LfpLatencyPreTriggerRing::getCapacity() const
+{
+    return capacity;
+}
+
+int LfpLatencyPreTriggerRing::getNumAvailable() const
+{
+    return numAvailable;
+}
+
+void LfpLatencyPreTriggerRing::reset()
+{
+    writePosition = 0;
+    numAvailable = 0;
+}
+
+void LfpLatencyPreTriggerRing::write(int channel, const float *source, int numSamples, int offset)
+{
+    if (capacity == 0 || channel < 0 || channel >= numChannels)
+    {
+        return;
+    }
+
+    // Only the last capacity samples survive
+    int position = static_cast<int>((writePosition + static_cast<int64>(offset)) % capacity);
+    if (numSamples > capacity)
+    {
+        position = (position + numSamples - capacity) % capacity;
+        source += numSamples - capacity;
+        numSamples = capacity;
+    }
+    float *ring = samples.data() + static_cast<size_t>(channel) * capacity;
+    int first = std::min(numSamples, capacity - position);
+    FloatVectorOperations::abs(ring + position, source, first);
+    FloatVectorOperations::abs(ring, source + first, numSamples - first);
+}
+
+void LfpLatencyPreTriggerRing::advance(int numSamples)
+{
+    if (capacity == 0)
+    {
+        return;
+    }
+    writePosition = static_cast<int>((writePosition + static_cast<int64>(numSamples)) % capacity);
+    numAvailable = static_cast<int>(std::min<int64>(capacity, numAvailable + static_cast<int64>(numSamples)));
+}
+
+void LfpLatencyPreTriggerRing::copyLatest(int channel, float *dest, int numSamples) const
+{
+    if (numSamples <= 0 || channel < 0 || channel >= numChannels)
+    {
+        return;
+    }
+    const float *ring = samples.data() + static_cast<size_t>(channel) * capacity;
+    int start = (writePosition - numSamples + capacity) % capacity;
+    int first = std::min(numSamples, capacity - start);
+    FloatVectorOperations::copy(dest, ring + start, first);
+    FloatVectorOperations::copy(dest + first, ring, numSamples - first);
+}
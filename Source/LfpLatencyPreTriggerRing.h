@@ -0,0 +1,75 @@
+/*
+    ------------------------------------------------------------------
+
+    This file is part of APTrack, a plugin for the Open-Ephys Gui
+
+    Copyright (C) 2019-2023 Eli Lilly and Company, University of Bristol, Open Ephys
+    Authors: Aidan Nickerson, Grace Stangroome, Merle Zhang, James O'Sullivan, Manuel Martinez
+
+    ------------------------------------------------------------------
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef LFPLATENCYPRETRIGGERRING_H_INCLUDED
+#define LFPLATENCYPRETRIGGERRING_H_INCLUDED
+
+#include <ProcessorHeaders.h>
+#include <vector>
+
+/**
+    Continuous ring of the most recent rectified samples of each cached channel.
+
+    The audio thread writes every data block into the ring, whether or not a track is being recorded,
+    and copies the samples leading up to a stimulus into the head of the new track.
+*/
+class LfpLatencyPreTriggerRing
+{
+public:
+    LfpLatencyPreTriggerRing();
+
+    /** Allocates capacity samples for each of numChannels channels and forgets their contents.
+        Must not be called while the audio thread is writing. */
+    void allocate(int numChannels, int capacity);
+
+    int getCapacity() const;
+
+    /** Returns the number of samples that can be copied, less than the capacity until it has filled once */
+    int getNumAvailable() const;
+
+    /** Forgets all samples, for example after a gap in the data */
+    void reset();
+
+    /** Rectifies numSamples samples into the ring of a channel, offset samples behind the write position.
+        Safe to call for different channels in parallel, call advance() once all channels are written. */
+    void write(int channel, const float *source, int numSamples, int offset = 0);
+
+    /** Moves the write position past the numSamples samples just written to every channel */
+    void advance(int numSamples);
+
+    /** Copies the most recent numSamples samples of a channel, oldest first. numSamples must not exceed getNumAvailable(). */
+    void copyLatest(int channel, float *dest, int numSamples) const;
+
+private:
+    std::vector<float> samples; // channel-major, capacity samples per channel
+    int numChannels;
+    int capacity;
+    int writePosition;          // index of the next sample written to each channel
+    int numAvailable;
+
+    JUCE_DECLARE_NON_COPYABLE(LfpLatencyPreTriggerRing);
+};
+
+#endif // LFPLATENCYPRETRIGGERRING_H_INCLUDED
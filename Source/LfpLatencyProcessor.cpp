@@ -33,6 +33,9 @@
 // #include "C:\\Users\\gsboo\\source\\repos\\plugin-GUI\\JuceLibraryCode\\modules\\juce_core\\misc\\juce_Result.h"
 #include <map>
 #include <vector>
+#include <algorithm>
+#include <cstring>
+#include <thread>
 
 // If the processor uses a custom editor, it needs its header to instantiate it
 // #include "ExampleEditor.h"
@@ -40,13 +43,18 @@
 std::mutex savingAndLoadingLock;
 
 LfpLatencyProcessor::LfpLatencyProcessor()
-    : GenericProcessor("APTrack"), fifoIndex(0), eventReceived(false), samplesPerSubsampleWindow(60), samplesAfterStimulusStart(0), messages(),
-      spikeGroups(0)
+    : GenericProcessor("APTrack"), fifoIndex(0),
+      thresholdEstimator(MAX_SPIKE_GROUPS),
+      spikeGroups(MAX_SPIKE_GROUPS), spikeGroupSlots(MAX_SPIKE_GROUPS), nextSpikeGroupUid(1), trackScheduleNext(0),
+      groupDiscovery(*this),
+      eventReceived(false), samplesPerSubsampleWindow(60), samplesAfterStimulusStart(0), currentSampleNumber(0)
 
 {
     pulsePalController = new ppController(this);
-    spikeGroups.reserve(100);
-    dataCacheTimestamps.reserve(3000); // resrve 3k timestamps
+    trackGroups.reserve(MAX_SPIKE_GROUPS);
+    liveSlotsScratch.resize(MAX_SPIKE_GROUPS);
+    trackSchedule.reserve(MAX_SPIKE_GROUPS);
+    pendingOnsets.reserve(MAX_PENDING_ONSETS);
 
     // Parameter controlling number of samples per subsample window
     // auto parameter0 = new Parameter ("detectionThreshold", 1, 4000, 1000, 0);
@@ -57,19 +65,10 @@ LfpLatencyProcessor::LfpLatencyProcessor()
     //	auto parameter2 = new Parameter ("lowThresholdColor", 1.0f, 1000.0f, 60.0f, 0);
     //   parameters.add (parameter2);
 
-    // Initialize array
-    for (auto ii = 0; ii < DATA_CACHE_SIZE_TRACKS * DATA_CACHE_SIZE_SAMPLES; ii++)
-    {
-        dataCache[ii] = 0.0f;
-    }
-
-    // Initialize array
-    for (auto ii = 0; ii < DATA_CACHE_SIZE_TRACKS; ii++)
-    {
-        spikeLocation[ii] = 0.0f;
-    }
+    currentTrackPublished = false;
 
     currentTrack = 0; // currentTrack increments before adding first row.
+    currentSample = 0;
 
     // Set default channels
     dataChannel_idx = 0;
@@ -77,15 +76,66 @@ LfpLatencyProcessor::LfpLatencyProcessor()
 
     // Set default stimulus threshold
     stimulus_threshold = 2.5f;
-}
 
-void LfpLatencyProcessor::timerCallback(int timerID)
-{
-    if (timerID == 1)
-    {
-        eventReceived = false;
-        stopTimer(1);
-    }
+    // Set default refractory period, re-arming no faster than the old 200 ms timer
+    refractoryPeriod_ms = 10.0f;
+    maxStimulusRate_Hz = 5.0f;
+    dataSampleRate = 30000.0f;
+    triggerSampleRate = 30000.0f;
+    dataStreamIndex = 0;
+    requestedDataStreamIndex = 0;
+    dataStreamId = 0;
+    dataStreamFirstChannel = 0;
+    dataStreamNumChannels = 1;
+    samplesSinceStimulus = std::numeric_limits<int64>::max() / 2;
+    updateRefractorySamples();
+    refractoryChanged = false;
+
+    // Analog threshold triggering by default
+    triggerSource = TRIGGER_SOURCE_ANALOG;
+    activeTriggerSource = TRIGGER_SOURCE_ANALOG;
+    triggerLine = 0;
+    lastTTLOnset = std::numeric_limits<int64>::min() / 2;
+
+    // Peak detection by default
+    detectionMode = DETECTION_MODE_PEAK;
+    templateCorrelation = DEFAULT_TEMPLATE_CORRELATION;
+    spikeTemplateLength = static_cast<int>(std::ceil(SPIKE_TEMPLATE_LENGTH_MS * dataSampleRate / 1000.0f));
+
+    // The cache is sized for the default rate until the stream is known
+    trackLength_ms = DEFAULT_TRACK_LENGTH_MS;
+    preTrigger_ms = DEFAULT_PRE_TRIGGER_MS;
+    artifactWindow_ms = 0;
+    averageTracks = DEFAULT_AVERAGE_TRACKS;
+    firingWindow = DEFAULT_FIRING_WINDOW;
+    trackingMode = TRACKING_MODE_STAIRCASE;
+    activeTrackingMode = TRACKING_MODE_STAIRCASE;
+    trackedEvaluationsPending = 0;
+    stimulusVoltagePending = false;
+    stimulusOwner = -1;
+    nextStimulusOwner = -1;
+    trackedGroups.reserve(MAX_SPIKE_GROUPS);
+    artifactWindowSamples = -1;
+    artifactTracks = 0;
+    artifactWeight = 1.0f;
+    trackHistory = DEFAULT_TRACK_HISTORY;
+    trackAllChannels = false;
+    cacheAllChannels = false;
+    cacheFirstChannel = 0;
+    rectifyBuffer = nullptr;
+    rectifyStart = 0;
+    rectifyLength = 0;
+    rectifyTrackLength = 0;
+
+    // No filtering by default
+    highPass_Hz = 0;
+    lowPass_Hz = 0;
+    notch_Hz = 0;
+    activeHighPass_Hz = 0;
+    activeLowPass_Hz = 0;
+    activeNotch_Hz = 0;
+    activeFilterSampleRate = 0;
+    allocateTrackCache();
 }
 
 LfpLatencyProcessor::~LfpLatencyProcessor()
@@ -94,7 +144,7 @@ LfpLatencyProcessor::~LfpLatencyProcessor()
 
 void LfpLatencyProcessor::resetDataChannel()
 {
-    dataChannel_idx = 0;
+    dataChannel_idx = dataStreamFirstChannel;
 }
 
 void LfpLatencyProcessor::resetTriggerChannel()
@@ -115,12 +165,7 @@ AudioProcessorEditor *LfpLatencyProcessor::createEditor()
 }
 void LfpLatencyProcessor::addMessage(std::string message)
 {
-    messages.push(message);
-}
-
-void LfpLatencyProcessor::addSpike(std::string spike)
-{
-    spikes.push(spike);
+    messages.push(currentSampleNumber.load(std::memory_order_relaxed), message);
 }
 
 // TODO: remove these. stimulusVoltage is handled by ppController
@@ -135,8 +180,124 @@ void LfpLatencyProcessor::setStimulusVoltage(float sv)
 
 void LfpLatencyProcessor::updateSettings()
 {
+    if (getNumDataStreams() > 0)
+    {
+        applyDataStream();
+    }
     createEventChannels();
 }
+
+void LfpLatencyProcessor::applyDataStream()
+{
+    dataStreamIndex = jlimit(0, getNumDataStreams() - 1, requestedDataStreamIndex);
+    auto stream = getDataStreams()[dataStreamIndex];
+    dataStreamId = stream->getStreamId();
+    dataSampleRate = stream->getSampleRate();
+
+    auto channels = stream->getContinuousChannels();
+    dataStreamFirstChannel = channels.size() > 0 ? channels[0]->getGlobalIndex() : 0;
+    dataStreamNumChannels = std::max(1, channels.size());
+    if (dataChannel_idx < dataStreamFirstChannel || dataChannel_idx >= dataStreamFirstChannel + dataStreamNumChannels)
+    {
+        dataChannel_idx = dataStreamFirstChannel;
+    }
+
+    // Onsets were queued as sample numbers of the previous stream
+    pendingOnsets.clear();
+    lastTTLOnset = std::numeric_limits<int64>::min() / 2;
+    updateRefractorySamples();
+    spikeTemplateLength = jlimit(3, MAX_SPIKE_TEMPLATE_LENGTH, static_cast<int>(std::ceil(SPIKE_TEMPLATE_LENGTH_MS * dataSampleRate / 1000.0f)));
+    allocateTrackCache();
+}
+
+bool LfpLatencyProcessor::startAcquisition()
+{
+    // Stream, track length and history are only applied while the audio thread is stopped
+    if (getNumDataStreams() > 0)
+    {
+        applyDataStream();
+    }
+    pendingOnsets.clear();
+    // Groups are listed afresh for the first track
+    trackGroups.clear();
+    trackSchedule.clear();
+    trackScheduleNext = 0;
+    spikeGroupSlots.setReaderActive(true);
+    trackLog.start();
+    spikeSerializer.start();
+    groupDiscovery.start();
+
+    // The audio thread takes one share itself, leave another core for the rest of the signal chain
+    if (trackCache.getNumChannels() >= PARALLEL_CHANNEL_THRESHOLD)
+    {
+        channelWorkers.start(jlimit(0, 7, static_cast<int>(std::thread::hardware_concurrency()) - 2));
+    }
+    return true;
+}
+
+bool LfpLatencyProcessor::stopAcquisition()
+{
+    channelWorkers.stop();
+    trackLog.stop();
+    spikeSerializer.stop();
+    groupDiscovery.stop();
+    spikeGroupSlots.setReaderActive(false);
+    return true;
+}
+
+void LfpLatencyProcessor::allocateTrackCache()
+{
+    int samplesPerTrack = std::max(1, static_cast<int>(std::ceil(trackLength_ms * dataSampleRate / 1000.0f)));
+    int preTriggerSamples = std::max(0, static_cast<int>(std::ceil(preTrigger_ms * dataSampleRate / 1000.0f)));
+    int numChannels = trackAllChannels ? dataStreamNumChannels : 1;
+
+    // Keep the whole cache within budget by shortening the history
+    int64 bytesPerTrack = static_cast<int64>(numChannels) * (preTriggerSamples + samplesPerTrack) * sizeof(float);
+    int numTracks = static_cast<int>(std::min<int64>(trackHistory, std::max<int64>(1, (int64(MAX_TRACK_CACHE_MB) << 20) / bytesPerTrack)));
+    if (numTracks < trackHistory)
+    {
+        std::cout << "Track history limited to " << numTracks << " tracks for " << numChannels << " channels" << std::endl;
+    }
+
+    // A search window never extends past the track
+    spikeDetector.prepare(samplesPerTrack);
+
+    int artifactSamples = std::min(samplesPerTrack, static_cast<int>(std::ceil(artifactWindow_ms * dataSampleRate / 1000.0f)));
+    if (artifactSamples == artifactWindowSamples && samplesPerTrack == trackCache.getSamplesPerTrack() && preTriggerSamples == trackCache.getPreTriggerSamples() && numTracks == trackCache.getNumTracks() && numChannels == trackCache.getNumChannels() && trackAllChannels == cacheAllChannels && dataStreamFirstChannel == cacheFirstChannel)
+    {
+        return;
+    }
+    trackCache.allocate(numChannels, numTracks, samplesPerTrack, preTriggerSamples);
+    artifactWindowSamples = artifactSamples;
+    artifactTemplate.assign(static_cast<size_t>(numChannels) * artifactWindowSamples, 0.0f);
+    artifactTracks = 0;
+    preTriggerRing.allocate(numChannels, preTriggerSamples);
+    filterBank.prepare(numChannels);
+    trackAverage.allocate(numChannels, samplesPerTrack);
+    noiseEstimator.allocate(numChannels);
+    averageRow.assign(samplesPerTrack, 0.0f);
+    cacheAllChannels = trackAllChannels;
+    cacheFirstChannel = dataStreamFirstChannel;
+
+    // Nothing of the current track survives, wait for the next stimulus
+    currentSample = samplesPerTrack;
+    currentTrackPublished = true;
+    trackSchedule.clear();
+    trackScheduleNext = 0;
+}
+
+void LfpLatencyProcessor::updateRefractorySamples()
+{
+    // The trigger re-arms after whichever is longer, the refractory period or the minimum stimulus interval
+    float minimumInterval_ms = refractoryPeriod_ms;
+    if (maxStimulusRate_Hz > 0)
+    {
+        minimumInterval_ms = std::max(minimumInterval_ms, 1000.0f / maxStimulusRate_Hz);
+    }
+    // At least one sample, otherwise the onset sample would re-trigger itself
+    refractorySamples = std::max<int64>(1, static_cast<int64>(std::ceil(minimumInterval_ms * triggerSampleRate / 1000.0f)));
+    refractoryDataSamples = std::max<int64>(1, static_cast<int64>(std::ceil(minimumInterval_ms * dataSampleRate / 1000.0f)));
+}
 // create event channel for pulsepal
 void LfpLatencyProcessor::createEventChannels()
 {
@@ -188,139 +349,208 @@ void LfpLatencyProcessor::setParameter(int parameterIndex, float newValue)
 {
 }
 
-// NOTE NOT CURRENTLY USED! Events detected in process() instead
-/**
-void LfpLatencyProcessor::handleEvent (const EventChannel* eventInfo, const MidiMessage& event, int sampleNum)
+void LfpLatencyProcessor::handleTTLEvent(TTLEventPtr event)
 {
-    //If TTL event received
-    if (Event::getEventType(event) == EventChannel::TTL)
+    if (event->getLine() != triggerLine || !event->getState())
     {
-        //Deserialize (decode) event
-        TTLEventPtr ttl = TTLEvent::deserializeFromMessage(event, eventInfo);
-
-        const int eventState         = ttl->getState();
-        const int eventChannel    = ttl->getChannel();
+        return;
+    }
 
-        //std::cout << "Received event on channel " << eventChannel
-        //           << " with value " << eventState << std::endl;
+    // Events carry the sample number of their own stream
+    uint16 eventStreamId = event->getStreamId();
+    int eventSample = static_cast<int>(event->getSampleNumber() - getFirstSampleNumberForBlock(eventStreamId));
+    queueStimulusOnset(getDataSampleNumber(eventStreamId, eventSample, dataStreamId), 1.0f);
+}
 
-        if (eventState == 5) //JumpLine
+void LfpLatencyProcessor::queueStimulusOnset(int64 sampleNumber, float triggerAmplitude)
+{
+    if (activeTriggerSource == TRIGGER_SOURCE_TTL)
+    {
+        // Edges are exact, only the refractory period needs enforcing
+        if (sampleNumber - lastTTLOnset < refractoryDataSamples)
         {
-            //Set flags
-            eventReceived = true;
-            fifoIndex = 0;
-            lastWindowPeak = 0;
-            windowSampleCount = 0;
-
-            //clear buffer
-            for (size_t i = 0; i < FIFO_BUFFER_SIZE;++i) {
-                fifo[i] = 0.0;
-            }
-
+            return;
         }
+        lastTTLOnset = sampleNumber;
+    }
+    if (pendingOnsets.size() < MAX_PENDING_ONSETS)
+    {
+        pendingOnsets.push_back({sampleNumber, triggerAmplitude});
     }
 }
-*/
+
 void LfpLatencyProcessor::addSpikeGroup(SpikeInfo templateSpike, bool isSelected)
 {
-    SpikeGroup s = {};
-    s.templateSpike = templateSpike;
-    s.spikeHistory.reserve(100);
-    spikeGroups.push_back(s);
+    SpikeGroupHandle handle;
+    {
+        const std::lock_guard<std::mutex> lock(spikeGroups_mutex);
+        // Slots are allocated up front so process() never sees a reallocation
+        int slot = spikeGroupSlots.allocate();
+        if (slot < 0)
+        {
+            if (spikeGroupSlots.isFull())
+            {
+                std::cout << "Maximum number of spike groups reached" << std::endl;
+            }
+            else
+            {
+                std::cout << "Removed spike groups are still being evaluated, try again after the next stimulus" << std::endl;
+            }
+            return;
+        }
+        auto &s = spikeGroups[slot];
+        s = SpikeGroup();
+        s.uid = nextSpikeGroupUid++;
+        s.templateSpike = templateSpike;
+        s.waveform.assign(MAX_SPIKE_TEMPLATE_LENGTH, 0.0f);
+        handle = spikeGroupSlots.publish(slot);
+    }
     if (isSelected)
-        setSelectedSpike(spikeGroups.size() - 1);
+        setSelectedSpike(spikeGroupSlots.getPosition(handle));
 };
-void LfpLatencyProcessor::removeSpikeGroup(int i){
-
-    // spikeGroups.erase(std::advance(spikeGroups.begin(),i));
+void LfpLatencyProcessor::removeSpikeGroup(int i)
+{
+    // The last group takes the place of the removed one, the audio thread stops evaluating it from the next track
+    const std::lock_guard<std::mutex> lock(spikeGroups_mutex);
+    auto handle = spikeGroupSlots.getHandle(i);
+    int slot = spikeGroupSlots.getSlot(handle);
+    if (slot < 0)
+    {
+        return;
+    }
+    spikeGroups[slot].isActive = false;
+    spikeGroupSlots.remove(handle);
 };
 SpikeGroup *LfpLatencyProcessor::getSpikeGroup(int i)
 {
-    const std::lock_guard<std::mutex> lock(spikeGroups_mutex);
-    return &spikeGroups[i];
+    int slot = spikeGroupSlots.getSlot(spikeGroupSlots.getHandle(i));
+    return slot >= 0 ? &spikeGroups[slot] : nullptr;
 }
-int LfpLatencyProcessor::getSpikeGroupCount()
+
+SpikeGroup *LfpLatencyProcessor::getSelectedSpikeGroup()
 {
-    return spikeGroups.size();
+    int slot = spikeGroupSlots.getSlot(selectedSpikeGroup);
+    return slot >= 0 ? &spikeGroups[slot] : nullptr;
 }
-
-int LfpLatencyProcessor::getSelectedSpike()
+std::vector<SpikeGroupSuggestion> LfpLatencyProcessor::getSpikeGroupSuggestions()
 {
-    for (int i = 0; i < spikeGroups.size(); i++)
-    {
-        if (spikeGroups[i].isActive)
-        {
-            return i;
-        }
-    }
-
-    return -1;
+    return groupDiscovery.getSuggestions();
 }
 
-int LfpLatencyProcessor::getTrackingSpike()
+int LfpLatencyProcessor::getSpikeGroupCount()
 {
-    for (int i = 0; i < spikeGroups.size(); i++)
-    {
-        if (spikeGroups[i].isTracking)
-        {
-            return i;
-        }
-    }
+    return spikeGroupSlots.size();
+}
 
-    return -1;
+int LfpLatencyProcessor::getSelectedSpike()
+{
+    return spikeGroupSlots.getPosition(selectedSpikeGroup);
 }
+
 void LfpLatencyProcessor::setSelectedSpike(int i)
 {
     // Set the current selected spike. Only one allowed.
-    for (int x = 0; x < this->getSpikeGroupCount(); x++)
+    auto previous = getSelectedSpikeGroup();
+    if (previous != nullptr)
     {
-        auto sg = this->getSpikeGroup(x);
-        sg->isActive = x == i;
+        previous->isActive = false;
+    }
+    selectedSpikeGroup = spikeGroupSlots.getHandle(i);
+    auto selected = getSelectedSpikeGroup();
+    if (selected != nullptr)
+    {
+        selected->isActive = true;
     }
 }
 
 void LfpLatencyProcessor::setSelectedSpikeLocation(int loc)
 {
-    int i = getSelectedSpike();
-    if (i == -1)
+    auto spikeGroup = getSelectedSpikeGroup();
+    if (spikeGroup == nullptr)
     {
         return;
     }
-    spikeGroups[i].templateSpike.spikeSampleLatency = loc;
+    spikeGroup->templateSpike.spikeSampleLatency = loc;
 }
 
 void LfpLatencyProcessor::setSelectedSpikeThreshold(float val)
 {
-    int i = getSelectedSpike();
-    if (i == -1)
+    auto spikeGroup = getSelectedSpikeGroup();
+    if (spikeGroup == nullptr)
     {
         return;
     }
-    spikeGroups[i].templateSpike.threshold = val;
+    spikeGroup->templateSpike.threshold = val;
+}
+
+void LfpLatencyProcessor::setSelectedSpikeNoiseMultiplier(float multiplier)
+{
+    auto spikeGroup = getSelectedSpikeGroup();
+    if (spikeGroup == nullptr)
+    {
+        return;
+    }
+    spikeGroup->templateSpike.noiseMultiplier = multiplier;
 }
 
 void LfpLatencyProcessor::setSelectedSpikeWindow(int window)
 {
-    int i = getSelectedSpike();
-    if (i == -1)
+    auto spikeGroup = getSelectedSpikeGroup();
+    if (spikeGroup == nullptr)
     {
         return;
     }
-    spikeGroups[i].templateSpike.windowSize = window;
+    spikeGroup->templateSpike.windowSize = window;
 }
-void LfpLatencyProcessor::setTrackingSpike(int i)
+void LfpLatencyProcessor::setSpikeGroupTracking(int i, bool tracking)
 {
-    // Set the current tracking spike. Only one allowed.
-    for (int x = 0; x < this->getSpikeGroupCount(); x++)
+    // Any number of groups can be tracked, the audio thread restarts the estimate of a newly tracked one
+    auto spikeGroup = getSpikeGroup(i);
+    if (spikeGroup == nullptr)
+    {
+        return;
+    }
+    if (tracking && !spikeGroup->isTracking)
     {
-        auto sg = this->getSpikeGroup(x);
-        sg->isTracking = x == i;
+        spikeGroup->trackingStarted = false;
     }
+    spikeGroup->isTracking = tracking;
 }
 
 void LfpLatencyProcessor::trackThreshold()
 {
-    // if the threshold is being tracked
+    // Once every tracked group has seen the current track, pick the voltage of the next stimulus
+    if (!stimulusVoltagePending || trackedEvaluationsPending > 0)
+    {
+        return;
+    }
+    stimulusVoltagePending = false;
+
+    trackedGroups.clear();
+    for (int i : trackGroups)
+    {
+        if (spikeGroups[i].isTracking && spikeGroups[i].trackingStarted)
+        {
+            trackedGroups.push_back(i);
+        }
+    }
+    if (trackedGroups.empty())
+    {
+        return;
+    }
+
+    if (activeTrackingMode == TRACKING_MODE_BAYESIAN)
+    {
+        // One voltage serves every group, chosen for what it tells about all of them
+        pulsePalController->setStimulusVoltage(thresholdEstimator.getNextVoltage(trackedGroups.data(), static_cast<int>(trackedGroups.size())));
+        return;
+    }
+
+    // Staircases take turns in table order, the next tracked group after the one that had the last stimulus
+    auto owner = std::find(trackedGroups.begin(), trackedGroups.end(), nextStimulusOwner);
+    auto next = owner != trackedGroups.end() ? owner + 1 : trackedGroups.end();
+    nextStimulusOwner = next != trackedGroups.end() ? *next : trackedGroups.front();
+    pulsePalController->setStimulusVoltage(spikeGroups[nextStimulusOwner].trackingVoltage);
 }
 
 float LfpLatencyProcessor::getTrackingIncreaseRate()
@@ -340,185 +570,688 @@ void LfpLatencyProcessor::setTrackingDecreaseRate(float sv)
     trackingDecreaseRate = sv;
 }
 
-void LfpLatencyProcessor::trackSpikes()
+void LfpLatencyProcessor::buildTrackSchedule()
 {
-    const std::lock_guard<std::mutex> lock(spikeGroups_mutex);
-    for (int i = 0; i < spikeGroups.size(); i++)
+    // Order the spike groups by the sample their search window closes on, so each is evaluated once per track
+    trackSchedule.clear();
+    trackScheduleNext = 0;
+    trackedEvaluationsPending = 0;
+
+    // A list changed during the copy is picked up on the next track, the old one still holds only live slots
+    int numLive = spikeGroupSlots.readLiveSlots(liveSlotsScratch.data());
+    if (numLive >= 0)
+    {
+        trackGroups.assign(liveSlotsScratch.begin(), liveSlotsScratch.begin() + numLive);
+    }
+    for (int i : trackGroups)
     {
-        auto &curSpikeGroup = spikeGroups[i];
-        auto &templateSpike = curSpikeGroup.templateSpike;
-        if (currentSample != templateSpike.spikeSampleLatency + templateSpike.windowSize ||
-            (!curSpikeGroup.spikeHistory.empty() && curSpikeGroup.spikeHistory.back().trackIndex == currentTrack))
+        predictSearchWindow(spikeGroups[i]);
+        if (spikeGroups[i].isTracking && getCacheChannel(spikeGroups[i].templateSpike.channel) >= 0)
         {
-            continue;
+            trackedEvaluationsPending++;
         }
-        auto curTrackBufferLoc = (currentTrack % DATA_CACHE_SIZE_TRACKS) * DATA_CACHE_SIZE_SAMPLES; // /TODO: this should take the current read buffer
-        auto windowStartInBuffer = curTrackBufferLoc + templateSpike.spikeSampleLatency - templateSpike.windowSize;
-        auto startPtr = dataCache + windowStartInBuffer;
-        bool spikeDetected = false;
-        auto maxValInWindow = std::max_element(startPtr, startPtr + (2 * templateSpike.windowSize));
-        if (*maxValInWindow < templateSpike.threshold) // if there is a value > threshold
+        if (spikeGroups[i].templateSpike.detectionSource == SPIKE_SOURCE_AVERAGE)
         {
-            // spike **not** detected
-            curSpikeGroup.recentHistory.push_back(false); // add to array
-            curSpikeGroup.recentHistory.pop_front();
+            // Evaluated on the average when the track is published
+            continue;
         }
-        else
+        int dueSample = spikeGroups[i].searchLatency + spikeGroups[i].searchWindow;
+        if (detectionMode == DETECTION_MODE_TEMPLATE)
         {
-            // spike detected
-            SpikeInfo newSpike = {};
-            newSpike.spikeSampleLatency = (maxValInWindow - (dataCache + curTrackBufferLoc)); // scary pointer arithmetic. find the position in array of the max - start of current track
-            newSpike.windowSize = templateSpike.windowSize;
-            newSpike.threshold = templateSpike.threshold;
-            newSpike.stimulusVoltage = this->pulsePalController->getStimulusVoltage();
-            newSpike.spikePeakValue = *maxValInWindow;
-            newSpike.spikeSampleNumber = this->dataCacheTimestamps[currentTrack] + newSpike.spikeSampleLatency;
-            newSpike.trackIndex = currentTrack;
-            curSpikeGroup.spikeHistory.push_back(newSpike);
-            spikeGroups[i].templateSpike.spikeSampleLatency = newSpike.spikeSampleLatency;
-            curSpikeGroup.recentHistory.push_back(true);
-            curSpikeGroup.recentHistory.pop_front();
-            spikeDetected = true;
+            // The waveform around the last latency in the window must be cached as well
+            dueSample += spikeTemplateLength - spikeTemplateLength / 2;
+        }
+        trackSchedule.push_back({dueSample, i});
+    }
+    std::sort(trackSchedule.begin(), trackSchedule.end(),
+              [](const SpikeGroupEvaluation &a, const SpikeGroupEvaluation &b)
+              { return a.dueSample < b.dueSample; });
+}
 
-            // #TODO: move this to its own function
-            stringstream json_out;
-            auto s = &newSpike;
-            json_out << "{"
-                     << "\"spikeSampleLatency\":" << s->spikeSampleLatency
-                     << ", \"windowSize\":" << s->windowSize
-                     << ", \"threshold\":" << s->threshold
-                     << ", \"stimulusVoltage\":" << s->stimulusVoltage
-                     << ", \"spikePeakValue\":" << s->spikePeakValue
-                     << ", \"spikeSampleNumber\":" << s->spikeSampleNumber
-                     << ", \"trackIndex\":" << s->trackIndex
-                     << ", \"spikeGroup\":" << i
-                     << "}";
-            // #TODO: re-enable - v0.6 genericprocessor breaks custom text streams. see https://github.com/open-ephys/plugin-GUI/issues/547
-            //  TextEventPtr event = TextEvent::createTextEvent(spikeEventPtr, s->spikeSampleNumber, json_out.str());
-            //  addEvent(event, s->spikeSampleLatency);
-            broadcastMessage(json_out.str());
-        }
-        if (curSpikeGroup.isTracking) // threshold tracking
-        {
-            float sv = this->pulsePalController->getStimulusVoltage();
-            if (spikeDetected)
-            {
-                // request increase
-                this->pulsePalController->setStimulusVoltage(sv - trackingDecreaseRate);
-            }
-            else
-            {
-                this->pulsePalController->setStimulusVoltage(sv + trackingIncreaseRate);
-                // request decrease
-            }
+void LfpLatencyProcessor::predictSearchWindow(SpikeGroup &spikeGroup)
+{
+    // The user moved or resized the window since the last detection, start again from where it is now
+    const auto &templateSpike = spikeGroup.templateSpike;
+    if (!spikeGroup.windowPredictor.follows(templateSpike.spikeSampleLatency, templateSpike.windowSize))
+    {
+        spikeGroup.windowPredictor.reset(templateSpike.spikeSampleLatency, templateSpike.windowSize, dataSampleRate);
+    }
+    spikeGroup.windowPredictor.predict();
+    spikeGroup.searchLatency = jmax(0, roundToInt(spikeGroup.windowPredictor.getLatency()));
+    spikeGroup.searchWindow = spikeGroup.windowPredictor.getWindow();
+}
+
+void LfpLatencyProcessor::updateSpikeTemplate(SpikeGroup &spikeGroup, const float *trackRow, int rowLength, int latency)
+{
+    // Start again if the waveform was averaged at another sample rate
+    if (spikeGroup.waveformLength != spikeTemplateLength)
+    {
+        std::fill(spikeGroup.waveform.begin(), spikeGroup.waveform.end(), 0.0f);
+        spikeGroup.waveformLength = spikeTemplateLength;
+        spikeGroup.waveformTracks = 0;
+    }
+    int segmentStart = latency - spikeTemplateLength / 2;
+    if (segmentStart < 0 || segmentStart + spikeTemplateLength > rowLength)
+    {
+        return;
+    }
+    LfpLatencySpikeDetector::updateTemplate(spikeGroup.waveform.data(), spikeTemplateLength, spikeGroup.waveformTracks, SPIKE_TEMPLATE_MAX_TRACKS, trackRow + segmentStart);
+}
 
-            // #TODO: update 50pct threshold if at 50pct
-            float curPct = std::count(curSpikeGroup.recentHistory.begin(), curSpikeGroup.recentHistory.end(), true);
+void LfpLatencyProcessor::trackSpikes()
+{
+    // Evaluate every spike group whose search window has been fully cached
+    while (trackScheduleNext < static_cast<int>(trackSchedule.size()) && trackSchedule[trackScheduleNext].dueSample <= currentSample)
+    {
+        int i = trackSchedule[trackScheduleNext].spikeGroup;
+        trackScheduleNext++;
 
-            if (curPct == (int)(curSpikeGroup.recentHistory.size() / 2) && curSpikeGroup.spikeHistory.size() >= curSpikeGroup.recentHistory.size())
-            {
-                float o = 0;
-                for (int i = 0; i < curSpikeGroup.recentHistory.size(); i++)
-                {
-                    SpikeInfo sp = curSpikeGroup.spikeHistory[curSpikeGroup.spikeHistory.size() - i - 1];
-                    o += sp.stimulusVoltage;
-                }
-                o = o / curSpikeGroup.recentHistory.size();
-                curSpikeGroup.stimulusVoltage50pct = o;
-            }
+        // Groups on a channel that is not cached are left alone
+        int cacheChannel = getCacheChannel(spikeGroups[i].templateSpike.channel);
+        if (cacheChannel >= 0)
+        {
+            evaluateSpikeGroup(i, trackCache.getRow(cacheChannel, currentTrack), currentSample);
+            trackedEvaluationsPending -= spikeGroups[i].isTracking ? 1 : 0;
         }
-
-        // send message on digital channel
     }
 }
-void LfpLatencyProcessor::process(AudioSampleBuffer &buffer)
+
+void LfpLatencyProcessor::evaluateAveragedGroups()
 {
-    int numChannels = buffer.getNumChannels();
+    for (int i : trackGroups)
+    {
+        int cacheChannel = getCacheChannel(spikeGroups[i].templateSpike.channel);
+        if (spikeGroups[i].templateSpike.detectionSource == SPIKE_SOURCE_AVERAGE && cacheChannel >= 0)
+        {
+            evaluateSpikeGroup(i, averageRow.data(), trackAverage.readMean(cacheChannel, averageRow.data()));
+            trackedEvaluationsPending -= spikeGroups[i].isTracking ? 1 : 0;
+        }
+    }
+}
 
-    if ((numChannels < 0) || (numChannels <= dataChannel_idx) || (numChannels <= triggerChannel_idx)) // Avoids crashing when no data source connected
+void LfpLatencyProcessor::updateNoiseThreshold(SpikeInfo &templateSpike)
+{
+    float noise = noiseEstimator.getNoise(getCacheChannel(templateSpike.channel));
+    if (templateSpike.noiseMultiplier <= 0 || noise <= 0)
     {
         return;
     }
+    // Averaging uncorrelated noise over N tracks shrinks it by sqrt(N)
+    if (templateSpike.detectionSource == SPIKE_SOURCE_AVERAGE && trackAverage.getNumAveraged() > 1)
+    {
+        noise /= std::sqrt(static_cast<float>(trackAverage.getNumAveraged()));
+    }
+    templateSpike.threshold = templateSpike.noiseMultiplier * noise;
+}
 
-    auto ts = this->getFirstSampleNumberForBlock(getDataStreams()[0]->getStreamId());
-    // get num of samples in buffer
+void LfpLatencyProcessor::evaluateSpikeGroup(int i, const float *trackRow, int rowLength)
+{
+    auto &curSpikeGroup = spikeGroups[i];
+    auto &templateSpike = curSpikeGroup.templateSpike;
+    // Search the window predicted for this track, groups added since it started have none yet
+    auto windowStartInTrack = std::max(curSpikeGroup.searchLatency - curSpikeGroup.searchWindow, 0);
+    auto windowEndInTrack = std::min(curSpikeGroup.searchLatency + curSpikeGroup.searchWindow, rowLength);
+    if (windowEndInTrack <= windowStartInTrack)
+    {
+        return;
+    }
+    bool spikeDetected = false;
+    int spikeLatency = 0;
+    float spikeLatencyFine = 0;
+    updateNoiseThreshold(templateSpike);
+
+    // Correlation takes over from the peak once the group has an averaged waveform
+    int templateHalf = spikeTemplateLength / 2;
+    bool templateMatching = detectionMode == DETECTION_MODE_TEMPLATE && curSpikeGroup.waveformLength == spikeTemplateLength && curSpikeGroup.waveformTracks >= SPIKE_TEMPLATE_MIN_TRACKS;
+    if (templateMatching)
+    {
+        // Offsets place the waveform centre anywhere in the search window
+        auto signalStart = std::max(windowStartInTrack - templateHalf, 0);
+        auto signalEnd = std::min(windowEndInTrack + spikeTemplateLength - templateHalf, rowLength);
+        float score;
+        int offset = spikeDetector.matchTemplate(trackRow + signalStart, signalEnd - signalStart, curSpikeGroup.waveform.data(), spikeTemplateLength, score);
+        if (offset >= 0 && score >= templateCorrelation)
+        {
+            spikeDetected = true;
+            spikeLatency = signalStart + offset + templateHalf;
+            int numOffsets = signalEnd - signalStart - spikeTemplateLength + 1;
+            spikeLatencyFine = signalStart + templateHalf + LfpLatencySpikeDetector::refinePeakLatency(spikeDetector.getScores(), offset, 0, numOffsets);
+        }
+    }
+    else
+    {
+        auto startPtr = trackRow + windowStartInTrack;
+        auto maxValInWindow = std::max_element(startPtr, startPtr + (windowEndInTrack - windowStartInTrack));
+        if (*maxValInWindow >= templateSpike.threshold) // if there is a value > threshold
+        {
+            spikeDetected = true;
+            spikeLatency = maxValInWindow - trackRow; // position of the max relative to the start of the current track
+            spikeLatencyFine = LfpLatencySpikeDetector::refinePeakLatency(trackRow, spikeLatency, 0, rowLength);
+        }
+    }
 
-    int nSamples = buffer.getNumSamples(); // getNumSamples(dataChannel_idx);
+    if (!spikeDetected)
+    {
+        // spike **not** detected
+    }
+    else
+    {
+        // spike detected
+        SpikeInfo newSpike = {};
+        newSpike.spikeSampleLatency = spikeLatency;
+        newSpike.spikeLatencyFine = spikeLatencyFine;
+        newSpike.windowSize = curSpikeGroup.searchWindow;
+        newSpike.threshold = templateSpike.threshold;
+        newSpike.stimulusVoltage = trackCache.getMetadata(currentTrack).stimulusVoltage;
+        newSpike.spikePeakValue = trackRow[spikeLatency];
+        newSpike.spikeSampleNumber = trackCache.getMetadata(currentTrack).startSample + newSpike.spikeSampleLatency;
+        newSpike.trackIndex = currentTrack;
+        newSpike.channel = templateSpike.channel;
+        newSpike.detectionSource = templateSpike.detectionSource;
+        // The window follows the filtered latency rather than the raw peak
+        curSpikeGroup.templateSpike.spikeSampleLatency = curSpikeGroup.windowPredictor.update(newSpike.spikeLatencyFine);
+        curSpikeGroup.templateSpike.spikeLatencyFine = curSpikeGroup.windowPredictor.getLatency();
+        if (detectionMode == DETECTION_MODE_TEMPLATE)
+        {
+            updateSpikeTemplate(curSpikeGroup, trackRow, rowLength, spikeLatency);
+        }
 
-    // Data channel
-    const float *bufPtr = buffer.getReadPointer(dataChannel_idx);
+        // Serialized and broadcast with the rest of this track off the audio thread
+        spikeSerializer.push(newSpike, curSpikeGroup.uid);
+    }
+    curSpikeGroup.firingHistory.setWindow(firingWindow);
+    curSpikeGroup.firingHistory.push(spikeDetected, trackCache.getMetadata(currentTrack).stimulusVoltage);
 
-    // Trigger channel
-    const float *bufPtr_pulses = buffer.getReadPointer(triggerChannel_idx);
+    if (curSpikeGroup.isTracking) // threshold tracking
+    {
+        recordTrackingOutcome(i, spikeDetected);
+    }
 
-    // Debug channel, used to explore scalings
-    // const float* bufPtr_test = buffer.getReadPointer(23);
+    // send message on digital channel
+}
 
-    // For each sample in buffer
-    for (auto n = 0; n < nSamples; ++n)
+void LfpLatencyProcessor::recordTrackingOutcome(int i, bool spikeDetected)
+{
+    // A new mode or voltage range invalidates every estimate
+    float minVoltage = pulsePalController->getMinStimulusVoltage();
+    float maxVoltage = pulsePalController->getMaxStimulusVoltage();
+    if (activeTrackingMode != trackingMode || !thresholdEstimator.covers(minVoltage, maxVoltage))
     {
-        // Read sample from DATA buffer
-        float data = *(bufPtr + n) * 1.0f;
+        activeTrackingMode = trackingMode;
+        thresholdEstimator.reset(minVoltage, maxVoltage);
+        for (int j : trackGroups)
+        {
+            spikeGroups[j].trackingStarted = false;
+        }
+    }
 
-        // Read sample from TRIGGER (ADC) buffer
-        float data_pulses = *(bufPtr_pulses + n);
+    auto &curSpikeGroup = spikeGroups[i];
+    float stimulusVoltage = trackCache.getMetadata(currentTrack).stimulusVoltage;
+    if (!curSpikeGroup.trackingStarted)
+    {
+        curSpikeGroup.trackingStarted = true;
+        curSpikeGroup.trackingVoltage = stimulusVoltage;
+        thresholdEstimator.resetFibre(i);
+    }
+    stimulusVoltagePending = true;
 
-        // Read sample from Debug buffer
-        // float test_pulses = *(bufPtr_test + n);
+    if (activeTrackingMode == TRACKING_MODE_BAYESIAN)
+    {
+        // Every tracked fibre learns from every stimulus, whichever voltage it was given at
+        thresholdEstimator.update(i, stimulusVoltage, spikeDetected);
+        curSpikeGroup.stimulusVoltage50pct = thresholdEstimator.getThreshold(i);
+        return;
+    }
 
-        // If data is above threshold, and no event received lately
-        if (std::abs(data_pulses) > stimulus_threshold && !eventReceived) // this detects the current tracked spike
+    // Staircases only step on the stimuli given at their own voltage
+    if (stimulusOwner == i || stimulusOwner < 0)
+    {
+        if (spikeDetected)
         {
+            // request decrease
+            curSpikeGroup.trackingVoltage = stimulusVoltage - trackingDecreaseRate;
+        }
+        else
+        {
+            // request increase
+            curSpikeGroup.trackingVoltage = stimulusVoltage + trackingIncreaseRate;
+        }
+    }
 
-            // TODO: this is an antipattern. We should get the global timestamp instead.
-            // Set flags
-            eventReceived = true;
-            // We have a pulse, start refactoy period timer
-            startTimer(1, 200); // from 600
+    // Firing half the time over a full window, the mean voltage of the window is the 50pct threshold
+    const auto &firingHistory = curSpikeGroup.firingHistory;
+    if (firingHistory.isFull() && firingHistory.getNumFired() == firingHistory.getWindow() / 2)
+    {
+        curSpikeGroup.stimulusVoltage50pct = firingHistory.getMeanVoltage();
+    }
+}
 
-            // Reset fifo index (so that buffer overwrites
-            fifoIndex = 0;
-            currentSample = 0;
-            // increment row count
-            currentTrack++;
+void LfpLatencyProcessor::process(AudioSampleBuffer &buffer)
+{
+    int numChannels = buffer.getNumChannels();
+
+    if ((numChannels < 0) || (numChannels <= dataChannel_idx) || (getNumDataStreams() == 0)) // Avoids crashing when no data source connected
+    {
+        return;
+    }
+    if (triggerSource != TRIGGER_SOURCE_TTL && numChannels <= triggerChannel_idx)
+    {
+        return;
+    }
+
+    int dataSamples = getNumSamplesInBlock(dataStreamId);
+    auto ts = getFirstSampleNumberForBlock(dataStreamId);
+    currentSampleNumber.store(ts, std::memory_order_relaxed);
 
-            // clear row
-            for (auto ii = 0; ii < DATA_CACHE_SIZE_SAMPLES; ii++)
+    updateFilterSections();
+
+    // The sample counts are only written by the audio thread
+    if (refractoryChanged.exchange(false))
+    {
+        updateRefractorySamples();
+    }
+
+    if (triggerSource != activeTriggerSource)
+    {
+        // Onsets queued by the other source would be counted twice
+        activeTriggerSource = triggerSource;
+        pendingOnsets.clear();
+        samplesSinceStimulus = std::numeric_limits<int64>::max() / 2;
+        lastTTLOnset = std::numeric_limits<int64>::min() / 2;
+    }
+
+    if (activeTriggerSource == TRIGGER_SOURCE_TTL)
+    {
+        // Onsets are queued by handleTTLEvent, no need to scan a trigger channel
+        checkForEvents();
+    }
+    else
+    {
+        // Trigger and data may come from different streams, each with its own block length, sample numbers and rate
+        auto triggerChannel = getContinuousChannel(triggerChannel_idx);
+        uint16 triggerStreamId = triggerChannel->getStreamId();
+        if (triggerChannel->getSampleRate() != triggerSampleRate)
+        {
+            triggerSampleRate = triggerChannel->getSampleRate();
+            updateRefractorySamples();
+        }
+        int triggerSamples = getNumSamplesInBlock(triggerStreamId);
+
+        // Trigger channel
+        const float *bufPtr_pulses = buffer.getReadPointer(triggerChannel_idx);
+
+        // Queue every onset in the trigger block as a data stream sample number
+        int scanStart = 0;
+        while (scanStart < triggerSamples)
+        {
+            int onset = findStimulusOnset(bufPtr_pulses, scanStart, triggerSamples);
+            samplesSinceStimulus += onset - scanStart;
+            if (onset == triggerSamples)
             {
-                dataCache[(currentTrack % DATA_CACHE_SIZE_TRACKS) * DATA_CACHE_SIZE_SAMPLES + ii] = 0.0f;
+                break;
             }
-            // write the timestamps
-            dataCacheTimestamps.push_back(ts + n); // #TODO: need to check this aligns with the datacache currentTrack
+
+            // The refractory period is counted in trigger samples from here
+            samplesSinceStimulus = 0;
+            queueStimulusOnset(getDataSampleNumber(triggerStreamId, onset, dataStreamId), bufPtr_pulses[onset]);
+            scanStart = onset;
         }
+    }
 
-        if (currentSample < (DATA_CACHE_SIZE_SAMPLES))
+    // Split the data block at the onsets that fall in it, each segment is cached in one pass
+    int segmentStart = 0;
+    int numStarted = 0;
+    for (; numStarted < static_cast<int>(pendingOnsets.size()); numStarted++)
+    {
+        auto onsetInBlock = pendingOnsets[numStarted].sampleNumber - ts;
+        if (onsetInBlock >= dataSamples)
         {
+            // The data stream has not reached this onset yet
+            break;
+        }
+        // An onset the data stream has already passed starts its track as early as possible
+        int onset = static_cast<int>(std::max<int64>(onsetInBlock, segmentStart));
 
-            dataCache[(currentTrack % DATA_CACHE_SIZE_TRACKS) * DATA_CACHE_SIZE_SAMPLES + currentSample] = 1.0f * std::abs(data);
+        appendToTrack(buffer, segmentStart, onset - segmentStart);
 
-            currentSample++;
-        }
-        trackSpikes(); // TODO: trackSpikes does not use the correct sample number for the message
+        // Close any search windows covered by this segment before a new track starts
+        trackSpikes();
+
+        startTrack(ts + onset, pendingOnsets[numStarted].triggerAmplitude);
+        segmentStart = onset;
     }
+    pendingOnsets.erase(pendingOnsets.begin(), pendingOnsets.begin() + numStarted);
+
+    appendToTrack(buffer, segmentStart, dataSamples - segmentStart);
+    trackSpikes();
 
     trackThreshold();
-    while (!messages.empty())
+    QueuedMessage message;
+    while (messages.pop(message))
     { // post pulsePal messages
         // #TODO: re-enable - v0.6 genericprocessor breaks custom text streams. see https://github.com/open-ephys/plugin-GUI/issues/547
-        // TextEventPtr event = TextEvent::createTextEvent(pulsePalEventPtr, CoreServices::getGlobalTimestamp(), messages.front());
+        // TextEventPtr event = TextEvent::createTextEvent(pulsePalEventPtr, message.sampleNumber, message.text);
         //  addEvent(event,0);
         // addEvent(pulsePalEventPtr, event, 0);
-        broadcastMessage(messages.front());
-        messages.pop();
+        broadcastMessage(message.text);
+    }
+    broadcastSpikeMessages();
+}
+
+void LfpLatencyProcessor::broadcastSpikeMessages()
+{
+    while (spikeSerializer.popMessage(spikeMessage))
+    {
+        // #TODO: re-enable - v0.6 genericprocessor breaks custom text streams. see https://github.com/open-ephys/plugin-GUI/issues/547
+        //  TextEventPtr event = TextEvent::createTextEvent(spikeEventPtr, s->spikeSampleNumber, spikeMessage);
+        broadcastMessage(spikeMessage);
+    }
+}
+
+int LfpLatencyProcessor::findStimulusOnset(const float *triggerData, int startSample, int endSample)
+{
+    // Skip whatever is left of the refractory period of the last stimulus
+    if (samplesSinceStimulus < refractorySamples)
+    {
+        startSample += static_cast<int>(std::min<int64>(refractorySamples - samplesSinceStimulus, endSample - startSample));
+    }
+    if (startSample >= endSample)
+    {
+        return endSample;
+    }
+
+    // Vectorised early out, most blocks contain no stimulus at all
+    auto range = FloatVectorOperations::findMinAndMax(triggerData + startSample, endSample - startSample);
+    if (std::max(std::abs(range.getStart()), std::abs(range.getEnd())) <= stimulus_threshold)
+    {
+        return endSample;
+    }
+
+    for (auto n = startSample; n < endSample; ++n)
+    {
+        if (std::abs(triggerData[n]) > stimulus_threshold)
+        {
+            return n;
+        }
+    }
+    return endSample;
+}
+
+int64 LfpLatencyProcessor::getDataSampleNumber(uint16 triggerStreamId, int triggerSample, uint16 dataStream)
+{
+    if (triggerStreamId == dataStream)
+    {
+        return getFirstSampleNumberForBlock(dataStream) + triggerSample;
+    }
+
+    // Streams are synchronised by Open Ephys, so their block timestamps share one clock
+    double onsetTime = getFirstTimestampForBlock(triggerStreamId) + triggerSample / triggerSampleRate;
+    double dataTime = onsetTime - getFirstTimestampForBlock(dataStream);
+    return getFirstSampleNumberForBlock(dataStream) + static_cast<int64>(std::llround(dataTime * dataSampleRate));
+}
+
+void LfpLatencyProcessor::startTrack(int64 startSampleNumber, float triggerAmplitude)
+{
+    // Set flags
+    eventReceived = true;
+
+    // This stimulus has already fired, so take its voltage and owner before publishing picks the next ones
+    float stimulusVoltage = pulsePalController->getStimulusVoltage();
+    int owner = nextStimulusOwner;
+
+    // The previous track is complete
+    publishTrack();
+
+    // Reset fifo index (so that buffer overwrites
+    fifoIndex = 0;
+    currentSample = 0;
+    // increment row count
+    currentTrack++;
+
+    // The row is not cleared, readers stop at the length it is published with
+    TrackMetadata metadata;
+    metadata.track = currentTrack;
+    metadata.startSample = startSampleNumber;
+    metadata.stimulusVoltage = stimulusVoltage;
+    stimulusOwner = owner;
+    metadata.triggerAmplitude = triggerAmplitude;
+    metadata.preTriggerLength = std::min(trackCache.getPreTriggerSamples(), preTriggerRing.getNumAvailable());
+    trackCache.beginTrack(metadata);
+    currentTrackPublished = false;
+
+    // Running mean of the first artifacts, an exponential average after that
+    artifactTracks = std::min(artifactTracks + 1, ARTIFACT_TEMPLATE_TRACKS);
+    artifactWeight = 1.0f / artifactTracks;
+
+    // The data block is split at the onset, so the ring ends on the last sample before it
+    if (metadata.preTriggerLength > 0)
+    {
+        int numCacheChannels = trackCache.getNumChannels();
+        if (numCacheChannels >= PARALLEL_CHANNEL_THRESHOLD)
+        {
+            channelWorkers.perform(copyPreTrigger, this, numCacheChannels);
+        }
+        else
+        {
+            copyPreTrigger(this, 0, numCacheChannels);
+        }
+    }
+
+    buildTrackSchedule();
+}
+
+void LfpLatencyProcessor::appendToTrack(const AudioSampleBuffer &buffer, int startSample, int numSamples)
+{
+    // Every sample goes through the filters and into the pre-trigger ring, anything past the end of the row is dropped from the track
+    int samplesPerTrack = trackCache.getSamplesPerTrack();
+    int trackSamples = jlimit(0, numSamples, samplesPerTrack - currentSample);
+    if (trackSamples == 0 && preTriggerRing.getCapacity() == 0 && filterBank.getNumSections() == 0)
+    {
+        return;
+    }
+
+    rectifyBuffer = &buffer;
+    rectifyStart = startSample;
+    rectifyLength = numSamples;
+    rectifyTrackLength = trackSamples;
+    int numCacheChannels = trackCache.getNumChannels();
+    if (numCacheChannels >= PARALLEL_CHANNEL_THRESHOLD)
+    {
+        channelWorkers.perform(rectifyChannels, this, numCacheChannels);
+    }
+    else
+    {
+        rectifyChannels(this, 0, numCacheChannels);
+    }
+    preTriggerRing.advance(numSamples);
+    currentSample += trackSamples;
+
+    // A full row will not change again, no need to wait for the next stimulus
+    if (trackSamples > 0 && currentSample == samplesPerTrack)
+    {
+        // Evaluate the remaining search windows before the visualizer can see the track
+        trackSpikes();
+        publishTrack();
+    }
+}
+
+void LfpLatencyProcessor::updateFilterSections()
+{
+    if (highPass_Hz == activeHighPass_Hz && lowPass_Hz == activeLowPass_Hz && notch_Hz == activeNotch_Hz && dataSampleRate == activeFilterSampleRate)
+    {
+        return;
+    }
+    activeHighPass_Hz = highPass_Hz;
+    activeLowPass_Hz = lowPass_Hz;
+    activeNotch_Hz = notch_Hz;
+    activeFilterSampleRate = dataSampleRate;
+
+    // Corners too close to Nyquist are left out
+    float maxFrequency = MAX_FILTER_FREQUENCY_FRACTION * dataSampleRate;
+    BiquadCoefficients sections[MAX_FILTER_SECTIONS];
+    int numSections = 0;
+    if (activeHighPass_Hz > 0 && activeHighPass_Hz < maxFrequency)
+    {
+        sections[numSections++] = BiquadCoefficients::highPass(dataSampleRate, activeHighPass_Hz);
+    }
+    if (activeLowPass_Hz > 0 && activeLowPass_Hz < maxFrequency)
+    {
+        sections[numSections++] = BiquadCoefficients::lowPass(dataSampleRate, activeLowPass_Hz);
+    }
+    if (activeNotch_Hz > 0 && activeNotch_Hz < maxFrequency)
+    {
+        sections[numSections++] = BiquadCoefficients::notch(dataSampleRate, activeNotch_Hz, NOTCH_FILTER_Q);
+    }
+    filterBank.setSections(sections, numSections);
+}
+
+void LfpLatencyProcessor::rectifyChannels(void *processor, int startChannel, int endChannel)
+{
+    auto p = static_cast<LfpLatencyProcessor *>(processor);
+    if (p->filterBank.getNumSections() > 0)
+    {
+        filterChannels(p, startChannel, endChannel);
+        return;
+    }
+    for (int cacheChannel = startChannel; cacheChannel < endChannel; cacheChannel++)
+    {
+        float *dest = p->trackCache.getRow(cacheChannel, p->currentTrack) + p->currentSample;
+        int dataChannel = p->getDataChannel(cacheChannel);
+        if (dataChannel < p->rectifyBuffer->getNumChannels())
+        {
+            const float *source = p->rectifyBuffer->getReadPointer(dataChannel, p->rectifyStart);
+            p->cacheTrackSamples(cacheChannel, dest, source, p->currentSample, p->rectifyTrackLength);
+            p->preTriggerRing.write(cacheChannel, source, p->rectifyLength);
+        }
+        else
+        {
+            FloatVectorOperations::clear(dest, p->rectifyTrackLength);
+        }
+    }
+}
+
+void LfpLatencyProcessor::cacheTrackSamples(int cacheChannel, float *dest, const float *source, int trackPosition, int numSamples)
+{
+    // Inside the artifact window: subtract the running template, update it with the residual, then rectify in place
+    int artifactSamples = jlimit(0, numSamples, artifactWindowSamples - trackPosition);
+    if (artifactSamples > 0)
+    {
+        float *artifact = artifactTemplate.data() + static_cast<size_t>(cacheChannel) * artifactWindowSamples + trackPosition;
+        FloatVectorOperations::subtract(dest, source, artifact, artifactSamples);
+        FloatVectorOperations::addWithMultiply(artifact, dest, artifactWeight, artifactSamples);
+        FloatVectorOperations::abs(dest, dest, artifactSamples);
+    }
+    FloatVectorOperations::abs(dest + artifactSamples, source + artifactSamples, numSamples - artifactSamples);
+}
+
+void LfpLatencyProcessor::filterChannels(LfpLatencyProcessor *p, int startChannel, int endChannel)
+{
+    // Missing channels are filtered as silence
+    static const float silence[FILTER_CHUNK] = {};
+    float filtered[FILTER_LANES][FILTER_CHUNK];
+    const float *inputs[FILTER_LANES];
+
+    for (int firstChannel = startChannel; firstChannel < endChannel; firstChannel += FILTER_LANES)
+    {
+        int numLanes = std::min(FILTER_LANES, endChannel - firstChannel);
+        for (int done = 0; done < p->rectifyLength; done += FILTER_CHUNK)
+        {
+            int numSamples = std::min(FILTER_CHUNK, p->rectifyLength - done);
+            for (int lane = 0; lane < numLanes; lane++)
+            {
+                int dataChannel = p->getDataChannel(firstChannel + lane);
+                inputs[lane] = dataChannel < p->rectifyBuffer->getNumChannels() ? p->rectifyBuffer->getReadPointer(dataChannel, p->rectifyStart + done) : silence;
+            }
+            p->filterBank.process(firstChannel, numLanes, inputs, filtered, numSamples);
+
+            // Same split as the unfiltered path: the head goes into the track, everything into the ring
+            int trackSamples = jlimit(0, numSamples, p->rectifyTrackLength - done);
+            for (int lane = 0; lane < numLanes; lane++)
+            {
+                int cacheChannel = firstChannel + lane;
+                if (trackSamples > 0)
+                {
+                    int trackPosition = p->currentSample + done;
+                    p->cacheTrackSamples(cacheChannel, p->trackCache.getRow(cacheChannel, p->currentTrack) + trackPosition, filtered[lane], trackPosition, trackSamples);
+                }
+                p->preTriggerRing.write(cacheChannel, filtered[lane], numSamples, done);
+            }
+        }
+    }
+}
+
+void LfpLatencyProcessor::copyPreTrigger(void *processor, int startChannel, int endChannel)
+{
+    auto p = static_cast<LfpLatencyProcessor *>(processor);
+    int preTriggerLength = p->trackCache.getMetadata(p->currentTrack).preTriggerLength;
+    for (int cacheChannel = startChannel; cacheChannel < endChannel; cacheChannel++)
+    {
+        float *row = p->trackCache.getRow(cacheChannel, p->currentTrack);
+        p->preTriggerRing.copyLatest(cacheChannel, row - preTriggerLength, preTriggerLength);
+    }
+}
+
+void LfpLatencyProcessor::estimateNoise(void *processor, int startChannel, int endChannel)
+{
+    auto p = static_cast<LfpLatencyProcessor *>(processor);
+    const TrackMetadata &metadata = p->trackCache.getMetadata(p->currentTrack);
+    for (int cacheChannel = startChannel; cacheChannel < endChannel; cacheChannel++)
+    {
+        // The pre-stimulus baseline is free of responses, without one the median of the whole track still ignores sparse spikes
+        const float *row = p->trackCache.getRow(cacheChannel, p->currentTrack);
+        if (metadata.preTriggerLength >= NOISE_MIN_BASELINE)
+        {
+            p->noiseEstimator.addTrack(cacheChannel, row - metadata.preTriggerLength, metadata.preTriggerLength);
+        }
+        else
+        {
+            p->noiseEstimator.addTrack(cacheChannel, row, metadata.validLength);
+        }
+    }
+}
+
+int LfpLatencyProcessor::getCacheChannel(int dataChannel)
+{
+    if (cacheAllChannels)
+    {
+        int cacheChannel = dataChannel - cacheFirstChannel;
+        return cacheChannel >= 0 && cacheChannel < trackCache.getNumChannels() ? cacheChannel : -1;
+    }
+    return dataChannel == dataChannel_idx ? 0 : -1;
+}
+
+int LfpLatencyProcessor::getDataChannel(int cacheChannel)
+{
+    return cacheAllChannels ? cacheFirstChannel + cacheChannel : dataChannel_idx;
+}
+
+void LfpLatencyProcessor::publishTrack()
+{
+    // The first track only exists once a stimulus has been seen
+    if (currentTrackPublished || currentTrack == 0)
+    {
+        return;
     }
-    while (!spikes.empty())
-    { // post Spike detected events
-        // # TODO: re-enable
-        // TextEventPtr event = TextEvent::createTextEvent(spikeEventPtr, CoreServices::getGlobalTimestamp(), spikes.front());
-        // addEvent(event, 0);
-        broadcastMessage(spikes.front());
-        spikes.pop();
+    trackLog.push(trackCache.publishTrack(currentTrack, currentSample));
+    if (trackCache.getNumChannels() >= PARALLEL_CHANNEL_THRESHOLD)
+    {
+        channelWorkers.perform(estimateNoise, this, trackCache.getNumChannels());
     }
+    else
+    {
+        estimateNoise(this, 0, trackCache.getNumChannels());
+    }
+
+    // Groups on the average are detected once it includes this track, their spikes are sent with it
+    trackAverage.setNumTracks(std::min(averageTracks, trackCache.getNumTracks() - 1));
+    trackAverage.addTrack(trackCache, currentTrack);
+    evaluateAveragedGroups();
+    spikeSerializer.endTrack(currentTrack);
+
+    // Whatever was not evaluated by now never will be
+    trackedEvaluationsPending = 0;
+    trackThreshold();
+    currentTrackPublished = true;
 }
 
 void LfpLatencyProcessor::saveRecoveryData(std::unordered_map<std::string, juce::String> *valuesMap)
@@ -669,40 +1402,59 @@ bool LfpLatencyProcessor::checkEventReceived()
 
 void LfpLatencyProcessor::resetEventFlag()
 {
-    // eventReceived = false;
+    eventReceived = false;
 }
 
-float *LfpLatencyProcessor::getdataCacheLastRow()
+int64 LfpLatencyProcessor::getLastPublishedTrack()
 {
-    float *rowPtr = (dataCache + (currentTrack % DATA_CACHE_SIZE_TRACKS) * DATA_CACHE_SIZE_SAMPLES);
-    return rowPtr;
+    return trackCache.getLastPublishedTrack();
 }
 
-float *LfpLatencyProcessor::getdataCacheRow(int track)
+int LfpLatencyProcessor::readPublishedTrack(int64 track, int startSample, int numSamples, float *dest)
 {
-    uint32_t colIndex = (((currentTrack - track) % DATA_CACHE_SIZE_TRACKS) + DATA_CACHE_SIZE_TRACKS) % DATA_CACHE_SIZE_TRACKS;
+    return trackCache.readTrack(getCacheChannel(dataChannel_idx), track, startSample, numSamples, dest);
+}
 
-    float *rowPtr = (dataCache + colIndex * DATA_CACHE_SIZE_SAMPLES);
+int LfpLatencyProcessor::readAverageTrack(int startSample, int numSamples, float *dest)
+{
+    return trackAverage.readAverage(getCacheChannel(dataChannel_idx), startSample, numSamples, dest);
+}
 
-    return rowPtr;
+int LfpLatencyProcessor::getNumAveragedTracks()
+{
+    return trackAverage.getNumAveraged();
 }
 
-int LfpLatencyProcessor::getLatencyData(int track)
+int LfpLatencyProcessor::getSamplesPerTrack()
 {
-    int data = spikeLocation[(((currentTrack - track) % DATA_CACHE_SIZE_TRACKS) + DATA_CACHE_SIZE_TRACKS) % DATA_CACHE_SIZE_TRACKS];
-    return data;
+    return trackCache.getSamplesPerTrack();
 }
 
-void LfpLatencyProcessor::pushLatencyData(int latency)
+int LfpLatencyProcessor::getPreTriggerSamples()
 {
-    spikeLocation[currentTrack % DATA_CACHE_SIZE_TRACKS] = latency;
+    return trackCache.getPreTriggerSamples();
 }
 
-float *LfpLatencyProcessor::getdataCache()
+int LfpLatencyProcessor::getTrackHistory()
 {
-    // float* rowPtr = (dataCache+currentTrack*DATA_CACHE_SIZE_SAMPLES);
-    return dataCache;
+    return trackCache.getNumTracks();
 }
+
+bool LfpLatencyProcessor::getTrackAllChannels()
+{
+    return cacheAllChannels;
+}
+
+int LfpLatencyProcessor::getDataStreamIndex()
+{
+    return dataStreamIndex;
+}
+
+float LfpLatencyProcessor::getDataSampleRate()
+{
+    return dataSampleRate;
+}
+
 int LfpLatencyProcessor::getSamplesPerSubsampleWindow()
 {
     return samplesPerSubsampleWindow;
@@ -720,12 +1472,12 @@ void LfpLatencyProcessor::changeParameter(int parameterID, float value)
         break;
     case 3:
         // change current trigger chan
-        if (value >= 0 && value < 25)
+        if (value >= 0 && value < getTotalContinuousChannels())
             triggerChannel_idx = value;
         break;
     case 4:
-        // change current trigger chan
-        if (value >= 0 && value < 25)
+        // change current data chan, only within the data stream the cache was sized for
+        if (value >= dataStreamFirstChannel && value < dataStreamFirstChannel + dataStreamNumChannels)
             dataChannel_idx = value;
         break;
     case 5:
@@ -733,6 +1485,105 @@ void LfpLatencyProcessor::changeParameter(int parameterID, float value)
         if (value >= 0)
             stimulus_threshold = value;
         break;
+    case 6:
+        // change trigger refractory period (ms)
+        if (value >= 0 && value != refractoryPeriod_ms)
+        {
+            refractoryPeriod_ms = value;
+            refractoryChanged = true;
+        }
+        break;
+    case 7:
+        // change maximum stimulation rate (Hz), 0 for no limit
+        if (value >= 0 && value != maxStimulusRate_Hz)
+        {
+            maxStimulusRate_Hz = value;
+            refractoryChanged = true;
+        }
+        break;
+    case 8:
+        // change post-stimulus track length (ms), applied when acquisition starts
+        if (value > 0 && value <= MAX_TRACK_LENGTH_MS)
+            trackLength_ms = value;
+        break;
+    case 9:
+        // change number of cached tracks, applied when acquisition starts
+        if (value >= 1 && value <= MAX_TRACK_HISTORY)
+            trackHistory = value;
+        break;
+    case 10:
+        // cache and track every channel instead of only the data channel, applied when acquisition starts
+        trackAllChannels = value > 0;
+        break;
+    case 11:
+        // change data stream, applied straight away unless acquisition is running
+        if (value >= 0 && value < getNumDataStreams() && value != requestedDataStreamIndex)
+        {
+            requestedDataStreamIndex = value;
+            if (!CoreServices::getAcquisitionStatus())
+                applyDataStream();
+        }
+        break;
+    case 12:
+        // change trigger source, analog threshold or TTL line
+        if (value == TRIGGER_SOURCE_ANALOG || value == TRIGGER_SOURCE_TTL)
+            triggerSource = value;
+        break;
+    case 13:
+        // change trigger TTL line
+        if (value >= 0 && value < MAX_TTL_LINES)
+            triggerLine = value;
+        break;
+    case 14:
+        // change spike detection mode, peak or template correlation
+        if (value == DETECTION_MODE_PEAK || value == DETECTION_MODE_TEMPLATE)
+            detectionMode = value;
+        break;
+    case 15:
+        // change minimum template correlation
+        if (value >= 0 && value <= 1)
+            templateCorrelation = value;
+        break;
+    case 16:
+        // change pre-stimulus baseline kept at the head of each track (ms), applied when acquisition starts
+        if (value >= 0 && value <= MAX_PRE_TRIGGER_MS)
+            preTrigger_ms = value;
+        break;
+    case 17:
+        // change high-pass corner (Hz), 0 for off
+        if (value >= 0)
+            highPass_Hz = value;
+        break;
+    case 18:
+        // change low-pass corner (Hz), 0 for off
+        if (value >= 0)
+            lowPass_Hz = value;
+        break;
+    case 19:
+        // change line noise notch (Hz), 0 for off
+        if (value >= 0)
+            notch_Hz = value;
+        break;
+    case 20:
+        // change stimulus artifact window (ms), 0 for no artifact subtraction, applied when acquisition starts
+        if (value >= 0 && value <= MAX_ARTIFACT_WINDOW_MS)
+            artifactWindow_ms = value;
+        break;
+    case 21:
+        // change number of tracks in the running average
+        if (value >= 1 && value < MAX_TRACK_HISTORY)
+            averageTracks = value;
+        break;
+    case 22:
+        // change number of stimuli the firing probability is taken over
+        if (value >= 1 && value <= MAX_FIRING_WINDOW)
+            firingWindow = value;
+        break;
+    case 23:
+        // change stimulus voltage tracking, staircase or bayesian
+        if (value == TRACKING_MODE_STAIRCASE || value == TRACKING_MODE_BAYESIAN)
+            trackingMode = value;
+        break;
     }
     /*if (parameterID == 1)
     {
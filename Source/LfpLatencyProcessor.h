@@ -40,7 +40,24 @@
 #include <unordered_map>
 #include <queue>
 #include <mutex>
+#include <atomic>
+#include <limits>
 #include "pulsePalController/ppController.h"
+#include "LfpLatencyTrackCache.h"
+#include "LfpLatencyTrackLog.h"
+#include "LfpLatencyPreTriggerRing.h"
+#include "LfpLatencyFilterBank.h"
+#include "LfpLatencyTrackAverage.h"
+#include "LfpLatencyNoiseEstimator.h"
+#include "LfpLatencyGroupDiscovery.h"
+#include "LfpLatencyChannelWorkers.h"
+#include "LfpLatencySpikeSerializer.h"
+#include "LfpLatencyMessageQueue.h"
+#include "LfpLatencySpikeDetector.h"
+#include "LfpLatencyWindowPredictor.h"
+#include "LfpLatencyFiringHistory.h"
+#include "LfpLatencyThresholdEstimator.h"
+#include "LfpLatencySpikeGroupSlots.h"
 
 // fifo buffer size. height in pixels of spectrogram image
 #define FIFO_BUFFER_SIZE 30000
@@ -57,43 +74,124 @@
 
 #define EVENT_DETECTION_THRESHOLD 1500
 
-#define DATA_CACHE_SIZE_SAMPLES 30000
+// Default post-stimulus window cached for each track
+#define DEFAULT_TRACK_LENGTH_MS 1000
 
-#define DATA_CACHE_SIZE_TRACKS 300
+#define MAX_TRACK_LENGTH_MS 5000
+
+// Filter stage ahead of the track cache, 0 Hz turns a section off
+#define NOTCH_FILTER_Q 20.0
+#define MAX_FILTER_FREQUENCY_FRACTION 0.45f // highest corner as a fraction of the sample rate
+
+// Stimulus artifact template subtracted from the start of each track
+#define MAX_ARTIFACT_WINDOW_MS 50
+#define ARTIFACT_TEMPLATE_TRACKS 20 // tracks averaged before older artifacts decay
+
+// Running average of the most recent tracks
+#define DEFAULT_AVERAGE_TRACKS 10
+
+// Spike group thresholds following the noise level, in multiples of its standard deviation
+#define MAX_NOISE_MULTIPLIER 20
+
+// Signals a spike group is detected on
+#define SPIKE_SOURCE_TRACK 0   // every track on its own
+#define SPIKE_SOURCE_AVERAGE 1 // the running average, evaluated as each track is published
+
+// Pre-stimulus baseline copied into the head of each track
+#define DEFAULT_PRE_TRIGGER_MS 20
+#define MAX_PRE_TRIGGER_MS 500
+
+// Default number of tracks kept in the cache
+#define DEFAULT_TRACK_HISTORY 300
+
+#define MAX_TRACK_HISTORY 3000
+
+// Upper bound on the track cache, the history is shortened when tracking many channels
+#define MAX_TRACK_CACHE_MB 2048
+
+// Number of cached channels from which rectification is split across worker threads
+#define PARALLEL_CHANNEL_THRESHOLD 32
+
+// Stimulus onsets waiting for the data stream to catch up with the trigger stream
+#define MAX_PENDING_ONSETS 64
+
+// Trigger sources
+#define TRIGGER_SOURCE_ANALOG 0 // threshold crossing on an analog trigger channel
+#define TRIGGER_SOURCE_TTL 1    // rising edge on a TTL line
+#define MAX_TTL_LINES 256
+
+// Spike detection modes
+#define DETECTION_MODE_PEAK 0     // largest rectified sample in the window above the group threshold
+#define DETECTION_MODE_TEMPLATE 1 // best normalised cross-correlation with the averaged waveform of the group
+
+// Stimulus voltage tracking of the tracked spike group
+#define TRACKING_MODE_STAIRCASE 0 // fixed steps down on a detection and up on a miss
+#define TRACKING_MODE_BAYESIAN 1  // most informative voltage under a posterior over threshold and slope
+
+// Averaged spike waveforms
+#define SPIKE_TEMPLATE_LENGTH_MS 2.0f // waveform length
+#define SPIKE_TEMPLATE_MIN_TRACKS 10  // peak detections averaged before correlation takes over
+#define SPIKE_TEMPLATE_MAX_TRACKS 50  // detections averaged before older ones decay
+#define DEFAULT_TEMPLATE_CORRELATION 0.7f
 
 // for debug
 #define SEARCH_BOX_WIDTH 3
 
+// spike group storage is reserved up front so the audio thread never sees it reallocate
+#define MAX_SPIKE_GROUPS 100
+
 class ppController;
 struct SpikeInfo
 {
-    int spikeSampleNumber;  // the recording sample number of the spike
+    int64 spikeSampleNumber; // the recording sample number of the spike
     int spikeSampleLatency; // the spike time relative to the stimulus
+    float spikeLatencyFine = 0; // the spike time relative to the stimulus in samples, with sub-sample precision
     float spikePeakValue;   // the peak value
     int windowSize = 30;    // the number of samples used to identify spike
     float threshold;        // the threshold value for the spike, used to detect
     float stimulusVoltage;  // the stimulus voltage used to illicit the spike
     int trackIndex;         // the track index for the stimulus (currentTrack)
+    int channel = 0;        // the data channel the spike is tracked on
+    int detectionSource = SPIKE_SOURCE_TRACK; // the signal the spike is detected on
+    float noiseMultiplier = 0;  // threshold in multiples of the channel noise, 0 keeps the fixed threshold
 };
 
 class SpikeGroup
 {
 public:
-    SpikeGroup() : spikeHistory(), recentHistory(10), templateSpike(), isTracking(false), isActive(false)
+    SpikeGroup() : firingHistory(), templateSpike(), isTracking(false), isActive(false)
     {
-        spikeHistory.reserve(1000);
     };
     // ~SpikeGroup();
 
-    std::vector<SpikeInfo> spikeHistory;
-    std::deque<bool> recentHistory;
+    LfpLatencyFiringHistory firingHistory; // whether the group fired for each of the most recent stimuli
     SpikeInfo templateSpike;         // the information used to determine the spike
     bool isTracking;                 // is the stimulus volt being tracked?
+    bool trackingStarted = false;    // has the audio thread started the threshold estimate since tracking was turned on
+    float trackingVoltage = 0;       // next stimulus voltage of the staircase of this group
     bool isActive;                   // is this spike currently active
     float stimulusVoltage50pct = -1; // the last known 50pct firing voltage
-    // const uint16 uid; // Unique identifier for the spike group #TODO: create uid
+    std::vector<float> waveform;     // averaged rectified waveform around the detections, for template matching
+    int waveformLength = 0;          // samples of waveform in use
+    int waveformTracks = 0;          // detections averaged into waveform so far
+    LfpLatencyWindowPredictor windowPredictor; // latency and its drift, steering the search window
+    int searchLatency = 0;           // centre of the search window for the current track
+    int searchWindow = 0;            // half-width of the search window for the current track, 0 until it has been predicted
+    int uid = 0;                     // identifies the group in the table and the spike log, never reused
+};
+
+struct PendingOnset
+{
+    int64 sampleNumber;     // onset as a sample number of the data stream
+    float triggerAmplitude; // trigger channel value at the onset sample
+};
+
+struct SpikeGroupEvaluation
+{
+    int dueSample;  // the track sample the search window closes on
+    int spikeGroup; // the slot of the spike group to evaluate
 };
-class LfpLatencyProcessor : public GenericProcessor, public MultiTimer
+class LfpLatencyProcessor : public GenericProcessor
 
 {
 public:
@@ -111,9 +209,8 @@ public:
     /** Optional method that informs the GUI if the processor is ready to function. If false acquisition cannot start. Defaults to true */
     // bool isReady();
 
-    /** Convenient interface for responding to incoming events. */
-    // NOTE NOT CURRENTLY USED! Events detected in process() instead
-    // void handleEvent (const EventChannel* eventInfo, const MidiMessage& event, int sampleNum) override;
+    /** Queues a stimulus onset for each rising edge on the trigger TTL line. Only called in TTL trigger mode. */
+    void handleTTLEvent(TTLEventPtr event) override;
     /** Defines the functionality of the processor.
         The process method is called every time a new data buffer is available.
     */
@@ -151,6 +248,12 @@ public:
     */
     void updateSettings() override;
 
+    /** Called before acquisition starts, applies a changed track length or history and opens the track log */
+    bool startAcquisition() override;
+
+    /** Called after acquisition stops, closes the track log */
+    bool stopAcquisition() override;
+
     // Channel used for the recording of spike data
     // virtual void createSpikeChannels() override;
 
@@ -161,17 +264,48 @@ public:
     void resetEventFlag();
 
     /**
-     Returns pointer to first element of latency track data of last (second most current) track. Equivalent to getdataCacheRow(1)
-     - Returns: pointer to first element of last (second most current) latency track
+     Returns the number of the most recent track that has finished and been published, or -1 if there is none
      */
-    float *getdataCacheLastRow();
+    int64 getLastPublishedTrack();
 
     /**
-     Returns pointer to first lement of raw circular array.
+     Copies samples of the data channel of a published track without blocking the audio thread
+     - Parameter track: track number, as returned by getLastPublishedTrack()
+     - Parameter startSample: first sample of the track to copy
+     - Parameter numSamples: number of samples to copy into dest
+
+     - Returns: the number of samples copied, fewer than numSamples if the track ended early (the rest is empty),
+       or -1 if the track is still being written or has since been overwritten, dest is then undefined
+     */
+    int readPublishedTrack(int64 track, int startSample, int numSamples, float *dest);
 
-     - Returns: pointer to raw circular array
+    /**
+     Copies samples of the running average of the data channel without blocking the audio thread
+     - Returns: the number of samples copied, fewer than numSamples past the end of the averaged tracks,
+       or -1 if the average changed during the copy, dest is then undefined
      */
-    float *getdataCache();
+    int readAverageTrack(int startSample, int numSamples, float *dest);
+
+    /** Returns the number of tracks in the running average */
+    int getNumAveragedTracks();
+
+    /** Returns the number of samples cached after each stimulus */
+    int getSamplesPerTrack();
+
+    /** Returns the number of samples cached before each stimulus, read with negative start samples */
+    int getPreTriggerSamples();
+
+    /** Returns the number of tracks held in the cache */
+    int getTrackHistory();
+
+    /** Returns true if every channel of the stream is cached and tracked, not only the data channel */
+    bool getTrackAllChannels();
+
+    /** Returns the index in getDataStreams() of the stream that is cached */
+    int getDataStreamIndex();
+
+    /** Returns the sample rate of the data stream, used to convert track samples to ms */
+    float getDataSampleRate();
 
     // Sets data channel back to default
     void resetDataChannel();
@@ -179,26 +313,11 @@ public:
     // Sets trigger channle to default
     void resetTriggerChannel();
 
-    /**
-     Returns pointer stored latency track data, one track at a time
-     - Parameter track: index of track (0 being current (earliest) track)
-
-     - Throws: 'std::out_of_range'
-                if 'track' index is out of range
-     - Returns: pointer to first element of latency track
-
-     */
-    float *getdataCacheRow(int track);
-
     void changeParameter(int parameterID, float value);
 
     int getParameterInt(int parameterID);
 
     int getSamplesPerSubsampleWindow();
-
-    void pushLatencyData(int latency);
-
-    int getLatencyData(int track);
     /*
     int windowSampleCount;
 
@@ -217,23 +336,29 @@ public:
     // Result makingFile;
 
     // Functions used to save data
+    /** Queues a message to be broadcast from the audio thread. Safe to call from any thread. */
     void addMessage(std::string message);
 
-    void addSpike(std::string spike);
-
     void addSpikeGroup(SpikeInfo templateSpike, bool isSelected = false);
     void removeSpikeGroup(int i);
 
+    /** Returns the spike group at a row of the table, or nullptr past the last one */
     SpikeGroup *getSpikeGroup(int i);
     int getSpikeGroupCount();
+
+    /** Returns the selected spike group, or nullptr if none is selected */
+    SpikeGroup *getSelectedSpikeGroup();
+
+    /** Returns the spike groups found by the background discovery on the displayed data channel, strongest first */
+    std::vector<SpikeGroupSuggestion> getSpikeGroupSuggestions();
     int getSelectedSpike();
     void setSelectedSpike(int i);
     void setSelectedSpikeLocation(int loc);
     void setSelectedSpikeThreshold(float val);
     void setSelectedSpikeWindow(int window);
+    void setSelectedSpikeNoiseMultiplier(float multiplier);
 
-    int getTrackingSpike();
-    void setTrackingSpike(int i);
+    void setSpikeGroupTracking(int i, bool tracking);
 
     float getStimulusVoltage();
     void setStimulusVoltage(float sv);
@@ -252,6 +377,18 @@ private:
 
     float trackingIncreaseRate = 0.01;
     float trackingDecreaseRate = 0.01;
+
+    int trackingMode;       // TRACKING_MODE_STAIRCASE or TRACKING_MODE_BAYESIAN
+    int activeTrackingMode; // mode used by the audio thread, the estimates restart when it changes
+    LfpLatencyThresholdEstimator thresholdEstimator; // one posterior per spike group
+    int trackedEvaluationsPending; // tracked spike groups not yet evaluated on the current track
+    bool stimulusVoltagePending;   // a tracked group has responded since the last stimulus voltage was chosen
+    int stimulusOwner;             // spike group whose staircase set the voltage of the current track, -1 for none
+    int nextStimulusOwner;         // spike group whose staircase set the voltage of the next track
+    std::vector<int> trackedGroups; // scratch list of the tracked spike groups
+
+    /** Adds the response of a tracked spike group to the current stimulus to its threshold estimate */
+    void recordTrackingOutcome(int i, bool spikeDetected);
     // debug
     float lastReceivedDACPulse;
 
@@ -260,19 +397,111 @@ private:
 
     int triggerChannel_threshold;
 
-    void timerCallback(int timerID) override;
-
-    void trackSpikes(); // updates the currently tracked spike group
+    void trackSpikes(); // evaluates the spike groups whose search window has closed
+    void buildTrackSchedule();       // orders the spike groups by due sample for a new track
+    void predictSearchWindow(SpikeGroup &spikeGroup); // places the search window of a spike group for a new track
+    void evaluateSpikeGroup(int i, const float *trackRow, int rowLength); // searches the window of a single spike group in the first rowLength samples of a row
+    void evaluateAveragedGroups();   // searches the running average for the spike groups detected on it
     void trackThreshold();
+    void broadcastSpikeMessages(); // broadcasts the messages the serializer has finished
+
+    /** Returns the index of the first trigger sample in [startSample, endSample) above the stimulus threshold, or endSample if there is none */
+    int findStimulusOnset(const float *triggerData, int startSample, int endSample);
+
+    /** Converts a trigger stream sample of this block into a data stream sample number using the block timestamps */
+    int64 getDataSampleNumber(uint16 triggerStreamId, int triggerSample, uint16 dataStream);
+
+    /** Starts a new track at the given stimulus sample number */
+    void startTrack(int64 startSampleNumber, float triggerAmplitude);
+
+    /** Rectifies a block of every cached channel into the current track */
+    void appendToTrack(const AudioSampleBuffer &buffer, int startSample, int numSamples);
+
+    /** ChannelJob rectifying the pending segment of cache channels [startChannel, endChannel) */
+    static void rectifyChannels(void *processor, int startChannel, int endChannel);
+
+    /** Filters, rectifies and caches the pending segment of cache channels [startChannel, endChannel), FILTER_LANES channels at a time */
+    static void filterChannels(LfpLatencyProcessor *p, int startChannel, int endChannel);
+
+    /** ChannelJob copying the pre-trigger ring into the head of the current track for cache channels [startChannel, endChannel) */
+    static void copyPreTrigger(void *processor, int startChannel, int endChannel);
+
+    /** ChannelJob adding the baseline of the current track to the noise level of cache channels [startChannel, endChannel) */
+    static void estimateNoise(void *processor, int startChannel, int endChannel);
+
+    /** Sets the threshold of a spike group from the noise level of its channel, if it follows the noise */
+    void updateNoiseThreshold(SpikeInfo &templateSpike);
+
+    /** Returns the cache channel holding a data channel, or -1 if that channel is not cached */
+    int getCacheChannel(int dataChannel);
+
+    /** Returns the data channel held by a cache channel */
+    int getDataChannel(int cacheChannel);
+
+    /** Marks the current track as finished so the visualizer may read it */
+    void publishTrack();
+
+    std::vector<SpikeGroup> spikeGroups;       // The groups of spikes that have been traced, one per slot
+    LfpLatencySpikeGroupSlots spikeGroupSlots; // which slots are in use, in table order
+    int nextSpikeGroupUid;
+    SpikeGroupHandle selectedSpikeGroup;
+    std::mutex spikeGroups_mutex;        // serialises changes made from the message thread
+    std::vector<int> trackGroups;        // slots of the spike groups evaluated on the current track
+    std::vector<int> liveSlotsScratch;   // copy of the slot list, kept if it proves torn
+
+    std::vector<SpikeGroupEvaluation> trackSchedule; // spike groups of the current track, ordered by due sample
+    int trackScheduleNext;                           // next entry of trackSchedule to evaluate
 
-    std::vector<SpikeGroup> spikeGroups; // The groups of spikes that have been traced
-    std::mutex spikeGroups_mutex;
+    LfpLatencyTrackCache trackCache; // rectified data and metadata of the most recent tracks
+    LfpLatencyTrackLog trackLog;     // metadata of every track, written to disk
+    bool currentTrackPublished;
 
-    float dataCache[(DATA_CACHE_SIZE_TRACKS + 1) * DATA_CACHE_SIZE_SAMPLES]; // TODO convert to vector.
-    std::vector<int> dataCacheTimestamps;
-    int spikeLocation[DATA_CACHE_SIZE_TRACKS];
+    float trackLength_ms;  // requested post-stimulus window
+    float preTrigger_ms;   // requested pre-stimulus baseline
+    int trackHistory;      // requested number of cached tracks
+    bool trackAllChannels; // requested caching of every channel
+    bool cacheAllChannels; // every channel is cached, otherwise only dataChannel_idx
+    int cacheFirstChannel; // global index of cache channel 0 when every channel is cached
 
-    bool eventReceived;
+    LfpLatencyChannelWorkers channelWorkers;
+    LfpLatencySpikeSerializer spikeSerializer; // serializes detections off the audio thread
+    std::string spikeMessage;                  // finished serializer message being broadcast
+    LfpLatencyGroupDiscovery groupDiscovery;   // suggests spike groups from the published tracks
+
+    LfpLatencyPreTriggerRing preTriggerRing; // the latest samples of each cached channel, copied ahead of each onset
+
+    LfpLatencyFilterBank filterBank; // optional filtering of each cached channel before it is rectified
+    float highPass_Hz;               // requested corners, 0 for off
+    float lowPass_Hz;
+    float notch_Hz;
+    float activeHighPass_Hz;         // corners the filter bank was built with, audio thread only
+    float activeLowPass_Hz;
+    float activeNotch_Hz;
+    float activeFilterSampleRate;
+
+    /** Rebuilds the filter sections if the requested corners or the sample rate have changed. Audio thread only. */
+    void updateFilterSections();
+
+    float artifactWindow_ms;            // requested length of the artifact template, 0 for off
+    int artifactWindowSamples;          // length of the artifact template in samples
+    std::vector<float> artifactTemplate; // running average of the start of each track, per cache channel
+    int artifactTracks;                 // tracks averaged into the template so far
+    float artifactWeight;               // weight of the current track in the template
+
+    /** Rectifies numSamples samples of a cache channel into the track at trackPosition,
+        subtracting the artifact template and updating it inside the artifact window */
+    void cacheTrackSamples(int cacheChannel, float *dest, const float *source, int trackPosition, int numSamples);
+
+    // Segment being rectified by rectifyChannels()
+    const AudioSampleBuffer *rectifyBuffer;
+    int rectifyStart;
+    int rectifyLength;      // samples written to the pre-trigger ring
+    int rectifyTrackLength; // leading samples also written to the current track
+
+    /** (Re)allocates the track cache if the sample rate, track length or history has changed */
+    void allocateTrackCache();
+
+    std::atomic<bool> eventReceived; // set on each stimulus, cleared by the visualizer
 
     EventChannel *pulsePalEventPtr;
     EventChannel *spikeEventPtr;
@@ -289,8 +518,55 @@ private:
 
     float stimulus_threshold;
 
-    std::queue<String> messages;
-    std::queue<String> spikes;
+    float refractoryPeriod_ms;  // minimum time after a stimulus before the trigger re-arms
+    float maxStimulusRate_Hz;   // maximum stimulation rate, 0 for no limit
+    float dataSampleRate;       // sample rate of the data stream
+    float triggerSampleRate;    // sample rate of the trigger stream, the refractory period is counted in it
+    int64 refractorySamples;    // refractory period in trigger stream samples, derived from the above
+    int64 refractoryDataSamples; // the same period in data stream samples, used for TTL triggers
+    std::atomic<bool> refractoryChanged; // set when the period or rate changes, the samples are recomputed by process()
+    int64 samplesSinceStimulus; // trigger samples processed since the last stimulus onset
+
+    int dataStreamIndex;          // stream the data channel and track cache belong to
+    int requestedDataStreamIndex; // stream selected in the visualizer, applied while acquisition is stopped
+    uint16 dataStreamId;
+    int dataStreamFirstChannel; // global index of the first channel of the data stream
+    int dataStreamNumChannels;
+
+    std::vector<PendingOnset> pendingOnsets; // onsets found in the trigger stream, in order
+
+    /** Makes the requested data stream current and sizes the track cache for it */
+    void applyDataStream();
+
+    /** Converts the refractory period and maximum stimulus rate into samples */
+    void updateRefractorySamples();
+
+    int detectionMode;               // DETECTION_MODE_PEAK or DETECTION_MODE_TEMPLATE
+    float templateCorrelation;       // minimum correlation for a template detection
+    int spikeTemplateLength;         // waveform length in data stream samples
+    LfpLatencySpikeDetector spikeDetector; // template matching scratch space, audio thread only
+
+    /** Adds the track segment around a detection to the averaged waveform of a spike group */
+    void updateSpikeTemplate(SpikeGroup &spikeGroup, const float *trackRow, int rowLength, int latency);
+
+    LfpLatencyTrackAverage trackAverage; // running average of the last averageTracks tracks
+    int averageTracks;                   // requested number of averaged tracks
+
+    int firingWindow; // stimuli the firing probability of every spike group is taken over
+    std::vector<float> averageRow;       // mean of one channel, for spike groups detected on the average
+
+    LfpLatencyNoiseEstimator noiseEstimator; // noise level of every cache channel, updated as each track is published
+
+    int triggerSource;           // TRIGGER_SOURCE_ANALOG or TRIGGER_SOURCE_TTL
+    int activeTriggerSource;     // source used by the audio thread, switched at the start of a block
+    int triggerLine;             // TTL line used as trigger, from 0
+    int64 lastTTLOnset;          // data stream sample number of the last TTL onset
+
+    /** Queues a stimulus onset at a data stream sample number, skipping onsets closer than the refractory period */
+    void queueStimulusOnset(int64 sampleNumber, float triggerAmplitude);
+
+    LfpLatencyMessageQueue messages;        // messages from any thread, broadcast by process()
+    std::atomic<int64> currentSampleNumber; // first sample number of the data block being processed
 
     JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(LfpLatencyProcessor);
 };
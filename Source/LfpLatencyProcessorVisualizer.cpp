@@ -39,6 +39,8 @@ LfpLatencyProcessorVisualizer::LfpLatencyProcessorVisualizer(LfpLatencyProcessor
 
     // Store pointer to processor
     processor = processor_pointer;
+    lastSamplesPerTrack = processor->getSamplesPerTrack();
+    lastDataStreamId = 0;
 }
 
 LfpLatencyProcessorVisualizer::~LfpLatencyProcessorVisualizer()
@@ -59,43 +61,42 @@ void LfpLatencyProcessorVisualizer::refreshState()
 
 void LfpLatencyProcessorVisualizer::update()
 {
+    // Populate stream combobox, keep current selection if availiable
+    int last_dataStreamId = content.dataStreamComboBox->getSelectedId();
+    content.dataStreamComboBox->clear(dontSendNotification);
+
+    auto dataStreams = processor->getDataStreams();
+    for (int ii = 0; ii < dataStreams.size(); ii++)
+    {
+        content.dataStreamComboBox->addItem(dataStreams[ii]->getName() + " (" + String(dataStreams[ii]->getSampleRate(), 0) + " Hz)", ii + 1);
+    }
+    if (content.dataStreamComboBox->indexOfItemId(last_dataStreamId) >= 0)
+    {
+        content.dataStreamComboBox->setSelectedId(last_dataStreamId, dontSendNotification);
+    }
+    else
+    {
+        content.dataStreamComboBox->setSelectedId(processor->getDataStreamIndex() + 1, dontSendNotification);
+    }
 
     // Get number of availiable channels and update label
     int numAvailiableChannels = processor->getTotalContinuousChannels(); // processor->getTotalDataChannels();
 
     std::cout << "LfpLatencyProcessorVisualizer::numAvailiableChannels" << numAvailiableChannels << std::endl;
 
-    // Populate combobox with new channels, keep current selection if availiable
-    //  get current selection
+    // The trigger may come from any stream, label each channel with its stream
     int last_triggerChannelId = content.triggerChannelComboBox->getSelectedId();
-    int last_dataChannelID = content.dataChannelComboBox->getSelectedId();
-
-    // Clear old values and repopulate combobox
     content.triggerChannelComboBox->clear();
-    content.dataChannelComboBox->clear();
-
     content.triggerChannelComboBox->addSectionHeading("Trigger");
-    content.dataChannelComboBox->addSectionHeading("Data");
 
     for (int ii = 0; ii < numAvailiableChannels; ii++)
     {
-        auto datastream = processor->getContinuousChannel(ii);
-        content.triggerChannelComboBox->addItem(datastream->getName(), ii + 1);
-        content.dataChannelComboBox->addItem(datastream->getName(), ii + 1);
-        // if (processor->getDataStream(ii)->get->getChannelType() == DataChannel::HEADSTAGE_CHANNEL)
-        // {
-        // 	content.triggerChannelComboBox->addItem("CH" + String(ii + 1), ii + 1);
-        // 	content.dataChannelComboBox->addItem("CH" + String(ii + 1), ii + 1);
-        // }
-        // else if (processor->getDataChannel(ii)->getChannelType() == DataChannel::ADC_CHANNEL)
-        // {
-        // 	content.triggerChannelComboBox->addItem("ADC" + String(ii + 1), ii + 1);
-        // 	//content.dataChannelComboBox->addItem("ADC" + String(ii + 1), ii + 1);
-        // }
+        auto channel = processor->getContinuousChannel(ii);
+        content.triggerChannelComboBox->addItem(processor->getDataStream(channel->getStreamId())->getName() + ": " + channel->getName(), ii + 1);
     }
     // If channel still availaible, keep selection, otherwise no don't select anything
     // Trigger chanel combobox
-    if (content.triggerChannelComboBox->getNumItems() <= last_triggerChannelId)
+    if (content.triggerChannelComboBox->indexOfItemId(last_triggerChannelId) >= 0)
     {
         content.triggerChannelComboBox->setSelectedId(last_triggerChannelId);
     }
@@ -104,15 +105,36 @@ void LfpLatencyProcessorVisualizer::update()
         content.triggerChannelComboBox->setSelectedId(0);
         processor->resetTriggerChannel();
     }
+
+    updateDataChannels();
+}
+
+void LfpLatencyProcessorVisualizer::updateDataChannels()
+{
+    // Only channels of the selected stream can be data channels
+    int last_dataChannelID = content.dataChannelComboBox->getSelectedId();
+    content.dataChannelComboBox->clear();
+    content.dataChannelComboBox->addSectionHeading("Data");
+
+    lastDataStreamId = content.dataStreamComboBox->getSelectedId();
+    auto dataStreams = processor->getDataStreams();
+    if (lastDataStreamId < 1 || lastDataStreamId > dataStreams.size())
+    {
+        return;
+    }
+    for (auto channel : dataStreams[lastDataStreamId - 1]->getContinuousChannels())
+    {
+        content.dataChannelComboBox->addItem(channel->getName(), channel->getGlobalIndex() + 1);
+    }
+
     // data channel combobox
-    if (content.dataChannelComboBox->getNumItems() <= last_dataChannelID)
+    if (content.dataChannelComboBox->indexOfItemId(last_dataChannelID) >= 0)
     {
         content.dataChannelComboBox->setSelectedId(last_dataChannelID);
     }
-    else
+    else if (content.dataChannelComboBox->getNumItems() > 0)
     {
-        content.triggerChannelComboBox->setSelectedId(0);
-        processor->resetDataChannel();
+        content.dataChannelComboBox->setSelectedId(content.dataChannelComboBox->getItemId(0));
     }
 }
 
@@ -140,9 +162,39 @@ void LfpLatencyProcessorVisualizer::timerCallback()
 
     processor->changeParameter(1, content.subsamplesPerWindow);
     processor->changeParameter(2, content.startingSample);
+    processor->changeParameter(11, content.dataStreamComboBox->getSelectedId() - 1);     // pass stream Id -1 = stream index
+    processor->changeParameter(12, content.triggerSourceComboBox->getSelectedId() - 1);  // pass source Id -1 = trigger source
     processor->changeParameter(3, content.triggerChannelComboBox->getSelectedId() - 1);  // pass channel Id -1 = channel index
+    processor->changeParameter(13, content.triggerLineComboBox->getSelectedId() - 1);    // pass line Id -1 = TTL line
     processor->changeParameter(4, content.dataChannelComboBox->getSelectedId() - 1);     // pass channel Id -1 = channel index
     processor->changeParameter(5, content.rightMiddlePanel->getTriggerThresholdValue()); // pass channel Id -1 = channel index
+    processor->changeParameter(6, content.rightMiddlePanel->getRefractoryPeriodValue());
+    processor->changeParameter(7, content.rightMiddlePanel->getMaxStimulusRateValue());
+    processor->changeParameter(8, content.rightMiddlePanel->getTrackLengthValue());
+    processor->changeParameter(9, content.rightMiddlePanel->getTrackHistoryValue());
+    processor->changeParameter(16, content.rightMiddlePanel->getPreTriggerValue());
+    processor->changeParameter(20, content.rightMiddlePanel->getArtifactWindowValue());
+    processor->changeParameter(21, content.rightMiddlePanel->getAverageTracksValue());
+    processor->changeParameter(22, content.rightMiddlePanel->getFiringWindowValue());
+    processor->changeParameter(17, content.highPassComboBox->getText().getIntValue()); // item text is the corner in Hz
+    processor->changeParameter(18, content.lowPassComboBox->getText().getIntValue());
+    processor->changeParameter(19, content.notchComboBox->getText().getIntValue());
+    processor->changeParameter(10, content.trackAllChannelsToggleButton->getToggleState());
+    processor->changeParameter(14, content.detectionModeComboBox->getSelectedId() - 1); // pass mode Id -1 = detection mode
+    processor->changeParameter(15, content.rightMiddlePanel->getTemplateCorrelationValue());
+    processor->changeParameter(23, content.trackingModeComboBox->getSelectedId() - 1); // pass mode Id -1 = tracking mode
+
+    if (content.dataStreamComboBox->getSelectedId() != lastDataStreamId)
+    {
+        updateDataChannels();
+    }
+
+    // The track cache is resized when acquisition starts
+    if (processor->getSamplesPerTrack() != lastSamplesPerTrack)
+    {
+        lastSamplesPerTrack = processor->getSamplesPerTrack();
+        content.spectrogramControlPanel->setTrackLength(lastSamplesPerTrack);
+    }
 
     // update spike tracking details
     content.stimulusVoltageSlider->setValue(processor->pulsePalController->getStimulusVoltage(), juce::NotificationType::dontSendNotification);
@@ -160,14 +212,14 @@ void LfpLatencyProcessorVisualizer::timerCallback()
     updateSpectrogram();
     content.spikeTracker->updateContent();
     std::ostringstream ss_ms_latency;
-    ss_ms_latency << std::fixed << std::setprecision(2) << (content.getSearchBoxSampleLocation() * 1000) / CoreServices::getGlobalSampleRate();
+    ss_ms_latency << std::fixed << std::setprecision(2) << (content.getSearchBoxSampleLocation() * 1000) / processor->getDataSampleRate();
     content.rightMiddlePanel->setROISpikeLatencyText(ss_ms_latency.str());
     // content.rightMiddlePanel->setROISpikeMagnitudeText("NaN");
-    int i = processor->getSelectedSpike();
-    if (i >= 0)
+    auto selectedSpikeGroup = processor->getSelectedSpikeGroup();
+    if (selectedSpikeGroup != nullptr)
     {
         // TODO: there should be a method that syncs the UI with the templateSpike.
-        auto ts = processor->getSpikeGroup(i)->templateSpike;
+        auto ts = selectedSpikeGroup->templateSpike;
         auto spikeVal = ts.spikeSampleLatency;
 
         content.setSearchBoxSampleLocation(spikeVal);
@@ -113,6 +113,13 @@ private:
 
     int lastSearchBoxLocation;
 
+    int lastSamplesPerTrack; // track length the spectrogram controls were last ranged for
+
+    int lastDataStreamId; // stream the data channel combobox was last populated for
+
+    /** Lists the channels of the selected data stream in the data channel combobox */
+    void updateDataChannels();
+
     Array<int> availableSpace = {0, 1, 2, 3};
 
     Array<int> availableThresholdSpace = {0, 1, 2, 3};
@@ -261,6 +261,68 @@ LfpLatencyProcessorVisualizerContentComponent::LfpLatencyProcessorVisualizerCont
     extendedColorScaleToggleButtonLabel = new Label("Extended_Scale_Toggle_Button_Label");
     extendedColorScaleToggleButtonLabel->setText("Extended Scale", sendNotification);
 
+    averagedViewToggleButton = new ToggleButton("");
+    averagedViewToggleButton->setColour(ToggleButton::ColourIds::tickDisabledColourId, Colours::lightgrey);
+    averagedViewToggleButtonLabel = new Label("Averaged_View_Toggle_Button_Label");
+    averagedViewToggleButtonLabel->setText("Averaged View", sendNotification);
+
+    trackAllChannelsToggleButton = new ToggleButton("");
+    trackAllChannelsToggleButton->setColour(ToggleButton::ColourIds::tickDisabledColourId, Colours::lightgrey);
+    trackAllChannelsToggleButtonLabel = new Label("Track_All_Channels_Toggle_Button_Label");
+    trackAllChannelsToggleButtonLabel->setText("Track All Channels", sendNotification);
+
+    detectionModeComboBox = new ComboBox("Detection Mode");
+    detectionModeComboBox->setEditableText(false);
+    detectionModeComboBox->setJustificationType(Justification::centredLeft);
+    detectionModeComboBox->addItem("Peak", DETECTION_MODE_PEAK + 1);
+    detectionModeComboBox->addItem("Template", DETECTION_MODE_TEMPLATE + 1);
+    detectionModeComboBox->setSelectedId(DETECTION_MODE_PEAK + 1, dontSendNotification);
+    detectionModeComboBoxLabel = new Label("Detection_Mode_Combo_Box_Label");
+    detectionModeComboBoxLabel->setText("Detection", sendNotification);
+
+    // Filter corners are read back from the item text, "Off" reads as 0 Hz
+    highPassComboBox = new ComboBox("High-Pass");
+    highPassComboBox->setEditableText(false);
+    highPassComboBox->setJustificationType(Justification::centredLeft);
+    highPassComboBox->addItemList({"Off", "1 Hz", "10 Hz", "100 Hz", "300 Hz"}, 1);
+    highPassComboBox->setSelectedId(1, dontSendNotification);
+    highPassComboBoxLabel = new Label("High_Pass_Combo_Box_Label");
+    highPassComboBoxLabel->setText("High-Pass", sendNotification);
+
+    lowPassComboBox = new ComboBox("Low-Pass");
+    lowPassComboBox->setEditableText(false);
+    lowPassComboBox->setJustificationType(Justification::centredLeft);
+    lowPassComboBox->addItemList({"Off", "1000 Hz", "3000 Hz", "6000 Hz", "10000 Hz"}, 1);
+    lowPassComboBox->setSelectedId(1, dontSendNotification);
+    lowPassComboBoxLabel = new Label("Low_Pass_Combo_Box_Label");
+    lowPassComboBoxLabel->setText("Low-Pass", sendNotification);
+
+    notchComboBox = new ComboBox("Notch");
+    notchComboBox->setEditableText(false);
+    notchComboBox->setJustificationType(Justification::centredLeft);
+    notchComboBox->addItemList({"Off", "50 Hz", "60 Hz"}, 1);
+    notchComboBox->setSelectedId(1, dontSendNotification);
+    notchComboBoxLabel = new Label("Notch_Combo_Box_Label");
+    notchComboBoxLabel->setText("Notch", sendNotification);
+
+    trackingModeComboBox = new ComboBox("Tracking Mode");
+    trackingModeComboBox->setEditableText(false);
+    trackingModeComboBox->setJustificationType(Justification::centredLeft);
+    trackingModeComboBox->addItem("Staircase", TRACKING_MODE_STAIRCASE + 1);
+    trackingModeComboBox->addItem("Bayesian", TRACKING_MODE_BAYESIAN + 1);
+    trackingModeComboBox->setSelectedId(TRACKING_MODE_STAIRCASE + 1, dontSendNotification);
+    trackingModeComboBoxLabel = new Label("Tracking_Mode_Combo_Box_Label");
+    trackingModeComboBoxLabel->setText("Tracking", sendNotification);
+
+    triggerSourceComboBox = new ComboBox("Trigger Source");
+    triggerSourceComboBox->setEditableText(false);
+    triggerSourceComboBox->setJustificationType(Justification::centredLeft);
+    triggerSourceComboBox->addItem("Analog Channel", TRIGGER_SOURCE_ANALOG + 1);
+    triggerSourceComboBox->addItem("TTL Line", TRIGGER_SOURCE_TTL + 1);
+    triggerSourceComboBox->setSelectedId(TRIGGER_SOURCE_ANALOG + 1, dontSendNotification);
+    triggerSourceComboBoxLabel = new Label("Trigger_Source_Combo_Box_Label");
+    triggerSourceComboBoxLabel->setText("Trigger Source", sendNotification);
+
     triggerChannelComboBox = new ComboBox("Trigger Channel");
     triggerChannelComboBox->setEditableText(false);
     triggerChannelComboBox->setJustificationType(Justification::centredLeft);
@@ -269,6 +331,24 @@ LfpLatencyProcessorVisualizerContentComponent::LfpLatencyProcessorVisualizerCont
     triggerChannelComboBoxLabel = new Label("Trigger_Channel_Combo_Box_Label");
     triggerChannelComboBoxLabel->setText("Trigger Channel", sendNotification);
 
+    triggerLineComboBox = new ComboBox("Trigger Line");
+    triggerLineComboBox->setEditableText(false);
+    triggerLineComboBox->setJustificationType(Justification::centredLeft);
+    for (int line = 0; line < 16; line++)
+    {
+        triggerLineComboBox->addItem("TTL " + String(line + 1), line + 1);
+    }
+    triggerLineComboBox->setSelectedId(1, dontSendNotification);
+    triggerLineComboBoxLabel = new Label("Trigger_Line_Combo_Box_Label");
+    triggerLineComboBoxLabel->setText("Trigger Line", sendNotification);
+
+    dataStreamComboBox = new ComboBox("Data Stream");
+    dataStreamComboBox->setEditableText(false);
+    dataStreamComboBox->setJustificationType(Justification::centredLeft);
+    dataStreamComboBox->setTextWhenNothingSelected(TRANS("None"));
+    dataStreamComboBoxLabel = new Label("Data_Stream_Combo_Box_Label");
+    dataStreamComboBoxLabel->setText("Data Stream", sendNotification);
+
     dataChannelComboBox = new ComboBox("Data Channel");
     dataChannelComboBox->setEditableText(false);
     dataChannelComboBox->setJustificationType(Justification::centredLeft);
@@ -371,6 +451,7 @@ LfpLatencyProcessorVisualizerContentComponent::LfpLatencyProcessorVisualizerCont
     addAndMakeVisible(spikeTracker = new juce::TableListBox("Tracked Spikes", &tcon));
     spikeTracker->setColour(ListBox::backgroundColourId, Colours::lightgrey);
     spikeTracker->getHeader().addColumn("S", 1, 30);
+    spikeTracker->getHeader().addColumn("Ch", 9, 30);
     spikeTracker->getHeader().addColumn("Location", 2, 100);
     spikeTracker->getHeader().addColumn("%", 3, 30);
     spikeTracker->getHeader().addColumn("Detection Value", 4, 100);
@@ -385,6 +466,9 @@ LfpLatencyProcessorVisualizerContentComponent::LfpLatencyProcessorVisualizerCont
     addAndMakeVisible(addNewSpikeButton = new juce::TextButton("+"));
     addNewSpikeButton->addListener(this);
 
+    addAndMakeVisible(suggestSpikeButton = new juce::TextButton("Suggest"));
+    suggestSpikeButton->addListener(this);
+
     addAndMakeVisible(cmLabel = new Label("cm_label"));
     cmLabel->setText("cm", dontSendNotification);
 
@@ -467,8 +551,16 @@ LfpLatencyProcessorVisualizerContentComponent::~LfpLatencyProcessorVisualizerCon
     textBox1 = nullptr;
     textBox2 = nullptr;
 
+    triggerSourceComboBox = nullptr;
     triggerChannelComboBox = nullptr;
+    triggerLineComboBox = nullptr;
     dataChannelComboBox = nullptr;
+    detectionModeComboBox = nullptr;
+    highPassComboBox = nullptr;
+    lowPassComboBox = nullptr;
+    notchComboBox = nullptr;
+    trackingModeComboBox = nullptr;
+    dataStreamComboBox = nullptr;
 
     spikeTracker = nullptr;
     spikeTrackerContent = nullptr;
@@ -520,9 +612,11 @@ void LfpLatencyProcessorVisualizerContentComponent::resized()
     stimulusSettingsView->setBounds(rightPane.removeFromTop(400));
 
     auto st_main = leftBottom.withTrimmedBottom(20);
-    auto st_button = leftBottom.removeFromBottom(20).removeFromRight(20);
+    auto st_buttons = leftBottom.removeFromBottom(20);
+    auto st_button = st_buttons.removeFromRight(20);
     spikeTracker->setBounds(st_main);
     addNewSpikeButton->setBounds(st_button);
+    suggestSpikeButton->setBounds(st_buttons.removeFromRight(70));
 
     // Grace's group
     // colorStyleComboBox->setBounds(785, 10, 120, 24);
@@ -745,6 +839,15 @@ void LfpLatencyProcessorVisualizerContentComponent::sliderValueChanged(Slider *s
         (*valuesMap)["searchBoxLocation"] = String(searchBoxLocation);
         std::cout << "searchBoxLocation" << searchBoxLocation << std::endl;
     }
+    if (sliderThatWasMoved->getName() == "Noise Threshold")
+    {
+        // 0 hands the selected group back to the image threshold slider
+        processor->setSelectedSpikeNoiseMultiplier(sliderThatWasMoved->getValue());
+        if (sliderThatWasMoved->getValue() == 0)
+        {
+            processor->setSelectedSpikeThreshold(detectionThreshold);
+        }
+    }
     if (sliderThatWasMoved->getName() == "Subsamples Per Window")
     {
         // auto subsamplesPerWindowOld = subsamplesPerWindow;
@@ -787,11 +890,65 @@ void LfpLatencyProcessorVisualizerContentComponent::sliderValueChanged(Slider *s
         stimuli = sliderThatWasMoved->getValue();
         stimuliNumber->setText(String(stimuli));
     }
-
     printf("running save custom params\n");
     tryToSave();
 }
 
+void LfpLatencyProcessorVisualizerContentComponent::showSpikeGroupSuggestions()
+{
+    auto suggestions = processor->getSpikeGroupSuggestions();
+    float samplesPerMs = processor->getDataSampleRate() / 1000.0f;
+    int dataChannel = processor->getParameterInt(2);
+
+    PopupMenu menu;
+    for (int i = 0; i < static_cast<int>(suggestions.size()); i++)
+    {
+        const auto &suggestion = suggestions[i];
+
+        // Suggestions inside the window of an existing group on this channel are shown but cannot be added again
+        bool tracked = false;
+        for (int j = 0; j < processor->getSpikeGroupCount(); j++)
+        {
+            auto spikeGroup = processor->getSpikeGroup(j);
+            if (spikeGroup == nullptr)
+            {
+                continue;
+            }
+            const auto &templateSpike = spikeGroup->templateSpike;
+            tracked |= templateSpike.channel == dataChannel && std::abs(templateSpike.spikeSampleLatency - suggestion.latency) <= templateSpike.windowSize;
+        }
+        String text = String(suggestion.latency / samplesPerMs, 2) + " ms, fires " + String(roundToInt(suggestion.firingFraction * 100)) + "%, jitter " + String(suggestion.jitter / samplesPerMs, 2) + " ms";
+        menu.addItem(i + 1, text, !tracked);
+    }
+    if (suggestions.empty())
+    {
+        menu.addItem(1, "No suggestions yet", false);
+    }
+
+    Component::SafePointer<LfpLatencyProcessorVisualizerContentComponent> safeThis(this);
+    menu.showMenuAsync(PopupMenu::Options().withTargetComponent(suggestSpikeButton.get()), [safeThis, suggestions](int result)
+                       {
+                           if (safeThis != nullptr && result >= 1 && result <= static_cast<int>(suggestions.size()))
+                           {
+                               safeThis->addSuggestedSpikeGroup(suggestions[result - 1]);
+                           } });
+}
+
+void LfpLatencyProcessorVisualizerContentComponent::addSuggestedSpikeGroup(const SpikeGroupSuggestion &suggestion)
+{
+    // The discovery threshold already separates the cluster from the noise, the window covers its jitter
+    SpikeInfo ts = {};
+    ts.threshold = suggestion.threshold;
+    ts.spikeSampleLatency = roundToInt(suggestion.latency);
+    ts.spikeLatencyFine = suggestion.latency;
+    ts.windowSize = jmax(searchBoxWidth, static_cast<int>(std::ceil(3 * suggestion.jitter)));
+    ts.channel = processor->getParameterInt(2);
+    ts.noiseMultiplier = rightMiddlePanel->getNoiseMultiplierValue();
+
+    processor->addSpikeGroup(ts, true);
+    spikeTracker->updateContent();
+}
+
 void LfpLatencyProcessorVisualizerContentComponent::mouseWheelMove(const juce::MouseEvent &e, const juce::MouseWheelDetails &wheel)
 {
     // e.getEventRelativeTo();
@@ -895,12 +1052,42 @@ void LfpLatencyProcessorVisualizerContentComponent::buttonClicked(Button *button
         view->addAndMakeVisible(extendedColorScaleToggleButton);
         view->addAndMakeVisible(extendedColorScaleToggleButtonLabel);
 
+        view->addAndMakeVisible(averagedViewToggleButton);
+        view->addAndMakeVisible(averagedViewToggleButtonLabel);
+
+        view->addAndMakeVisible(triggerSourceComboBox);
+        view->addAndMakeVisible(triggerSourceComboBoxLabel);
+
         view->addAndMakeVisible(triggerChannelComboBox);
         view->addAndMakeVisible(triggerChannelComboBoxLabel);
 
+        view->addAndMakeVisible(triggerLineComboBox);
+        view->addAndMakeVisible(triggerLineComboBoxLabel);
+
+        view->addAndMakeVisible(dataStreamComboBox);
+        view->addAndMakeVisible(dataStreamComboBoxLabel);
+
         view->addAndMakeVisible(dataChannelComboBox);
         view->addAndMakeVisible(dataChannelComboBoxLabel);
 
+        view->addAndMakeVisible(trackAllChannelsToggleButton);
+        view->addAndMakeVisible(trackAllChannelsToggleButtonLabel);
+
+        view->addAndMakeVisible(detectionModeComboBox);
+        view->addAndMakeVisible(detectionModeComboBoxLabel);
+
+        view->addAndMakeVisible(highPassComboBox);
+        view->addAndMakeVisible(highPassComboBoxLabel);
+
+        view->addAndMakeVisible(lowPassComboBox);
+        view->addAndMakeVisible(lowPassComboBoxLabel);
+
+        view->addAndMakeVisible(notchComboBox);
+        view->addAndMakeVisible(notchComboBoxLabel);
+
+        view->addAndMakeVisible(trackingModeComboBox);
+        view->addAndMakeVisible(trackingModeComboBoxLabel);
+
         view->addAndMakeVisible(stimuliNumber);
         view->addAndMakeVisible(stimuliNumberLabel);
         view->addAndMakeVisible(stimuliNumberSlider);
@@ -912,17 +1099,48 @@ void LfpLatencyProcessorVisualizerContentComponent::buttonClicked(Button *button
         extendedColorScaleToggleButton->setBounds(135, 40, 24, 24);
         extendedColorScaleToggleButtonLabel->setBounds(10, 40, 120, 24);
 
-        triggerChannelComboBox->setBounds(135, 70, 120, 24);
-        triggerChannelComboBoxLabel->setBounds(10, 70, 120, 24);
+        averagedViewToggleButton->setBounds(135, 70, 24, 24);
+        averagedViewToggleButtonLabel->setBounds(10, 70, 120, 24);
+
+        triggerSourceComboBox->setBounds(135, 100, 120, 24);
+        triggerSourceComboBoxLabel->setBounds(10, 100, 120, 24);
+
+        triggerChannelComboBox->setBounds(135, 130, 120, 24);
+        triggerChannelComboBoxLabel->setBounds(10, 130, 120, 24);
+
+        triggerLineComboBox->setBounds(135, 160, 120, 24);
+        triggerLineComboBoxLabel->setBounds(10, 160, 120, 24);
 
-        dataChannelComboBox->setBounds(135, 100, 120, 24);
-        dataChannelComboBoxLabel->setBounds(10, 100, 120, 24); // fine
+        dataStreamComboBox->setBounds(135, 190, 120, 24);
+        dataStreamComboBoxLabel->setBounds(10, 190, 120, 24);
+
+        dataChannelComboBox->setBounds(135, 220, 120, 24);
+        dataChannelComboBoxLabel->setBounds(10, 220, 120, 24);
+
+        trackAllChannelsToggleButton->setBounds(135, 250, 24, 24);
+        trackAllChannelsToggleButtonLabel->setBounds(10, 250, 120, 24);
+
+        detectionModeComboBox->setBounds(135, 280, 120, 24);
+        detectionModeComboBoxLabel->setBounds(10, 280, 120, 24);
+
+        highPassComboBox->setBounds(135, 310, 120, 24);
+        highPassComboBoxLabel->setBounds(10, 310, 120, 24);
+
+        lowPassComboBox->setBounds(135, 340, 120, 24);
+        lowPassComboBoxLabel->setBounds(10, 340, 120, 24);
+
+        notchComboBox->setBounds(135, 370, 120, 24);
+        notchComboBoxLabel->setBounds(10, 370, 120, 24);
+
+        trackingModeComboBox->setBounds(135, 400, 120, 24);
+        trackingModeComboBoxLabel->setBounds(10, 400, 120, 24);
 
         // stimuliNumberSlider->setBounds(114, 160, 72, 72);
         // stimuliNumber->setBounds(135, 130, 72, 24);
         // stimuliNumberLabel->setBounds(10, 130, 120, 24);
-        rightMiddlePanel->setBounds(10, 160, 280, 140);
-        view->setSize(300, 360);
+        // The sliders have outgrown a single column, they sit to the right of the selectors
+        rightMiddlePanel->setBounds(300, 0, 280, 780);
+        view->setSize(590, 788);
         auto &setupBox = juce::CallOutBox::launchAsynchronously(std::move(view), otherControlPanel->getOptionsBoundsInPanelParent(), this);
         setupBox.setLookAndFeel(new CustomLookAndFeel());
     }
@@ -932,12 +1150,21 @@ void LfpLatencyProcessorVisualizerContentComponent::buttonClicked(Button *button
         SpikeInfo ts = {};
         ts.threshold = detectionThreshold;
         ts.spikeSampleLatency = getSearchBoxSampleLocation();
+        ts.spikeLatencyFine = ts.spikeSampleLatency;
         ts.windowSize = searchBoxWidth;
+        ts.channel = processor->getParameterInt(2); // the data channel on display
+        ts.detectionSource = getAveragedView() ? SPIKE_SOURCE_AVERAGE : SPIKE_SOURCE_TRACK; // detect on what is on display
+        ts.noiseMultiplier = rightMiddlePanel->getNoiseMultiplierValue();
 
         processor->addSpikeGroup(
             ts, true);
         spikeTracker->updateContent();
     }
+
+    if (buttonThatWasClicked == suggestSpikeButton)
+    {
+        showSpikeGroupSuggestions();
+    }
     printf("running save custom params\n");
     tryToSave();
 }
@@ -962,6 +1189,11 @@ bool LfpLatencyProcessorVisualizerContentComponent::getExtendedColorScale() cons
     return extendedColorScale;
 }
 
+bool LfpLatencyProcessorVisualizerContentComponent::getAveragedView() const
+{
+    return averagedViewToggleButton->getToggleState();
+}
+
 int LfpLatencyProcessorVisualizerContentComponent::getSubsamplesPerWindow() const
 {
     return subsamplesPerWindow;
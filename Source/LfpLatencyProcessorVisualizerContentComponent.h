@@ -64,6 +64,7 @@ public:
 
     int getStartingSample() const;
     bool getExtendedColorScale() const;
+    bool getAveragedView() const;
     int getSubsamplesPerWindow() const;
     float getLowImageThreshold() const;
     float getHighImageThreshold() const;
@@ -167,6 +168,9 @@ private:
     ScopedPointer<ToggleButton> extendedColorScaleToggleButton;
     ScopedPointer<Label> extendedColorScaleToggleButtonLabel;
 
+    ScopedPointer<ToggleButton> averagedViewToggleButton;
+    ScopedPointer<Label> averagedViewToggleButtonLabel;
+
     ScopedPointer<Label> cmLabel;
 
     // ScopedPointer<GroupComponent> detectionControlGroup;
@@ -177,16 +181,50 @@ private:
     ScopedPointer<TextEditor> textBox1;
     ScopedPointer<TextEditor> textBox2;
 
+    ScopedPointer<ComboBox> triggerSourceComboBox;
+    ScopedPointer<Label> triggerSourceComboBoxLabel;
+
     ScopedPointer<ComboBox> triggerChannelComboBox;
     ScopedPointer<Label> triggerChannelComboBoxLabel;
 
+    ScopedPointer<ComboBox> triggerLineComboBox;
+    ScopedPointer<Label> triggerLineComboBoxLabel;
+
+    ScopedPointer<ComboBox> dataStreamComboBox;
+    ScopedPointer<Label> dataStreamComboBoxLabel;
+
     ScopedPointer<ComboBox> dataChannelComboBox;
     ScopedPointer<Label> dataChannelComboBoxLabel;
 
+    ScopedPointer<ToggleButton> trackAllChannelsToggleButton;
+    ScopedPointer<Label> trackAllChannelsToggleButtonLabel;
+
+    ScopedPointer<ComboBox> detectionModeComboBox;
+    ScopedPointer<Label> detectionModeComboBoxLabel;
+
+    ScopedPointer<ComboBox> highPassComboBox;
+    ScopedPointer<Label> highPassComboBoxLabel;
+
+    ScopedPointer<ComboBox> lowPassComboBox;
+    ScopedPointer<Label> lowPassComboBoxLabel;
+
+    ScopedPointer<ComboBox> notchComboBox;
+    ScopedPointer<Label> notchComboBoxLabel;
+
+    ScopedPointer<ComboBox> trackingModeComboBox;
+    ScopedPointer<Label> trackingModeComboBoxLabel;
+
     ScopedPointer<Slider> Trigger_threshold; // TODO
 
     ScopedPointer<TableListBox> spikeTracker;
     ScopedPointer<TextButton> addNewSpikeButton;
+    ScopedPointer<TextButton> suggestSpikeButton;
+
+    /** Pops up the spike groups found by the background discovery that are not tracked yet */
+    void showSpikeGroupSuggestions();
+
+    /** Adds a spike group for a suggestion picked from the menu */
+    void addSuggestedSpikeGroup(const SpikeGroupSuggestion &suggestion);
 
     ScopedPointer<Slider> stimuliNumberSlider;
     ScopedPointer<TextEditor> stimuliNumber;
@@ -37,9 +37,69 @@ LfpLatencyRightMiddlePanel::LfpLatencyRightMiddlePanel(LfpLatencyProcessorVisual
     triggerThreshold->addSliderListener(content);
     triggerThreshold->setSliderValue(2.5);
 
+    refractoryPeriod = new LfpLatencyLabelSlider("Refractory Period (ms)");
+    refractoryPeriod->setSliderRange(0, 1000, 1);
+    refractoryPeriod->addSliderListener(content);
+    refractoryPeriod->setSliderValue(10);
+
+    maxStimulusRate = new LfpLatencyLabelSlider("Max Stimulus Rate (Hz)");
+    maxStimulusRate->setSliderRange(0, 100, 0.5);
+    maxStimulusRate->addSliderListener(content);
+    maxStimulusRate->setSliderValue(5);
+
+    trackLength = new LfpLatencyLabelSlider("Track Length (ms)");
+    trackLength->setSliderRange(10, MAX_TRACK_LENGTH_MS, 10);
+    trackLength->addSliderListener(content);
+    trackLength->setSliderValue(DEFAULT_TRACK_LENGTH_MS);
+
+    trackHistory = new LfpLatencyLabelSlider("Track History");
+    trackHistory->setSliderRange(SPECTROGRAM_WIDTH / 5, MAX_TRACK_HISTORY, 1);
+    trackHistory->addSliderListener(content);
+    trackHistory->setSliderValue(DEFAULT_TRACK_HISTORY);
+
+    preTrigger = new LfpLatencyLabelSlider("Pre-Trigger (ms)");
+    preTrigger->setSliderRange(0, MAX_PRE_TRIGGER_MS, 1);
+    preTrigger->addSliderListener(content);
+    preTrigger->setSliderValue(DEFAULT_PRE_TRIGGER_MS);
+
+    artifactWindow = new LfpLatencyLabelSlider("Artifact Window (ms)");
+    artifactWindow->setSliderRange(0, MAX_ARTIFACT_WINDOW_MS, 0.5);
+    artifactWindow->addSliderListener(content);
+    artifactWindow->setSliderValue(0);
+
+    averageTracks = new LfpLatencyLabelSlider("Averaged Tracks");
+    averageTracks->setSliderRange(1, MAX_TRACK_HISTORY - 1, 1);
+    averageTracks->addSliderListener(content);
+    averageTracks->setSliderValue(DEFAULT_AVERAGE_TRACKS);
+
+    noiseMultiplier = new LfpLatencyLabelSlider("Noise Threshold");
+    noiseMultiplier->setSliderRange(0, MAX_NOISE_MULTIPLIER, 0.5);
+    noiseMultiplier->addSliderListener(content);
+    noiseMultiplier->setSliderValue(0);
+
+    firingWindow = new LfpLatencyLabelSlider("Firing Window");
+    firingWindow->setSliderRange(1, MAX_FIRING_WINDOW, 1);
+    firingWindow->addSliderListener(content);
+    firingWindow->setSliderValue(DEFAULT_FIRING_WINDOW);
+
+    templateCorrelation = new LfpLatencyLabelSlider("Template Correlation");
+    templateCorrelation->setSliderRange(0, 1, 0.01);
+    templateCorrelation->addSliderListener(content);
+    templateCorrelation->setSliderValue(DEFAULT_TEMPLATE_CORRELATION);
+
     addAndMakeVisible(ROISpikeLatency);
     addAndMakeVisible(ROISpikeMagnitude);
     addAndMakeVisible(triggerThreshold);
+    addAndMakeVisible(refractoryPeriod);
+    addAndMakeVisible(maxStimulusRate);
+    addAndMakeVisible(trackLength);
+    addAndMakeVisible(trackHistory);
+    addAndMakeVisible(preTrigger);
+    addAndMakeVisible(artifactWindow);
+    addAndMakeVisible(averageTracks);
+    addAndMakeVisible(noiseMultiplier);
+    addAndMakeVisible(firingWindow);
+    addAndMakeVisible(templateCorrelation);
 }
 
 void LfpLatencyRightMiddlePanel::resized()
@@ -56,6 +116,16 @@ void LfpLatencyRightMiddlePanel::resized()
 
     auto triggerThresholdHeight = 64;
     triggerThreshold->setBounds(area.removeFromTop(triggerThresholdHeight));
+    refractoryPeriod->setBounds(area.removeFromTop(triggerThresholdHeight));
+    maxStimulusRate->setBounds(area.removeFromTop(triggerThresholdHeight));
+    trackLength->setBounds(area.removeFromTop(triggerThresholdHeight));
+    trackHistory->setBounds(area.removeFromTop(triggerThresholdHeight));
+    preTrigger->setBounds(area.removeFromTop(triggerThresholdHeight));
+    artifactWindow->setBounds(area.removeFromTop(triggerThresholdHeight));
+    averageTracks->setBounds(area.removeFromTop(triggerThresholdHeight));
+    noiseMultiplier->setBounds(area.removeFromTop(triggerThresholdHeight));
+    firingWindow->setBounds(area.removeFromTop(triggerThresholdHeight));
+    templateCorrelation->setBounds(area.removeFromTop(triggerThresholdHeight));
 }
 
 void LfpLatencyRightMiddlePanel::setROISpikeLatencyText(const String &newText)
@@ -72,3 +142,53 @@ double LfpLatencyRightMiddlePanel::getTriggerThresholdValue() const
 {
     return triggerThreshold->getSliderValue();
 }
+
+double LfpLatencyRightMiddlePanel::getRefractoryPeriodValue() const
+{
+    return refractoryPeriod->getSliderValue();
+}
+
+double LfpLatencyRightMiddlePanel::getMaxStimulusRateValue() const
+{
+    return maxStimulusRate->getSliderValue();
+}
+
+double LfpLatencyRightMiddlePanel::getTrackLengthValue() const
+{
+    return trackLength->getSliderValue();
+}
+
+double LfpLatencyRightMiddlePanel::getTrackHistoryValue() const
+{
+    return trackHistory->getSliderValue();
+}
+
+double LfpLatencyRightMiddlePanel::getPreTriggerValue() const
+{
+    return preTrigger->getSliderValue();
+}
+
+double LfpLatencyRightMiddlePanel::getArtifactWindowValue() const
+{
+    return artifactWindow->getSliderValue();
+}
+
+double LfpLatencyRightMiddlePanel::getAverageTracksValue() const
+{
+    return averageTracks->getSliderValue();
+}
+
+double LfpLatencyRightMiddlePanel::getNoiseMultiplierValue() const
+{
+    return noiseMultiplier->getSliderValue();
+}
+
+double LfpLatencyRightMiddlePanel::getFiringWindowValue() const
+{
+    return firingWindow->getSliderValue();
+}
+
+double LfpLatencyRightMiddlePanel::getTemplateCorrelationValue() const
+{
+    return templateCorrelation->getSliderValue();
+}
@@ -49,10 +49,50 @@ public:
 
     double getTriggerThresholdValue() const;
 
+    /* Trigger refractory period in ms */
+    double getRefractoryPeriodValue() const;
+
+    /* Maximum stimulation rate in Hz, 0 for no limit */
+    double getMaxStimulusRateValue() const;
+
+    /* Post-stimulus window cached for each track in ms, applied when acquisition starts */
+    double getTrackLengthValue() const;
+
+    /* Number of cached tracks, applied when acquisition starts */
+    double getTrackHistoryValue() const;
+
+    /* Pre-stimulus baseline cached for each track in ms, applied when acquisition starts */
+    double getPreTriggerValue() const;
+
+    /* Start of each track cleaned of the stimulus artifact in ms, 0 for off, applied when acquisition starts */
+    double getArtifactWindowValue() const;
+
+    /* Number of tracks in the running average */
+    double getAverageTracksValue() const;
+
+    /* Threshold of new spike groups in multiples of the channel noise, 0 for a fixed threshold */
+    double getNoiseMultiplierValue() const;
+
+    /* Number of stimuli the firing probability is taken over */
+    double getFiringWindowValue() const;
+
+    /* Minimum normalised correlation for a template detection */
+    double getTemplateCorrelationValue() const;
+
 private:
     ScopedPointer<LfpLatencyLabelTextEditor> ROISpikeLatency;
     ScopedPointer<LfpLatencyLabelTextEditor> ROISpikeMagnitude;
     ScopedPointer<LfpLatencyLabelSlider> triggerThreshold;
+    ScopedPointer<LfpLatencyLabelSlider> refractoryPeriod;
+    ScopedPointer<LfpLatencyLabelSlider> maxStimulusRate;
+    ScopedPointer<LfpLatencyLabelSlider> trackLength;
+    ScopedPointer<LfpLatencyLabelSlider> trackHistory;
+    ScopedPointer<LfpLatencyLabelSlider> preTrigger;
+    ScopedPointer<LfpLatencyLabelSlider> artifactWindow;
+    ScopedPointer<LfpLatencyLabelSlider> averageTracks;
+    ScopedPointer<LfpLatencyLabelSlider> noiseMultiplier;
+    ScopedPointer<LfpLatencyLabelSlider> firingWindow;
+    ScopedPointer<LfpLatencyLabelSlider> templateCorrelation;
 };
 
 #endif
@@ -28,7 +28,15 @@
 #include "LfpLatencyProcessorVisualizerContentComponent.h"
 
 LfpLatencySpectrogram::LfpLatencySpectrogram(int imageWidth, int imageHeight)
-    : image(Image::RGB, imageWidth, imageHeight, true)
+    : image(Image::RGB, imageWidth, imageHeight, true),
+      bmap(tracksAmount * imageHeight),
+      columnPeaks(tracksAmount * imageHeight),
+      columnTrack(tracksAmount, -1),
+      emptyColumn(imageHeight),
+      cachedStartingSample(-1),
+      cachedSubsamplesPerWindow(-1),
+      cachedSamplesPerTrack(-1),
+      cachedAveragedView(false)
 {
     // Paint image
     paintAll(Colours::yellowgreen);
@@ -109,89 +117,65 @@ void LfpLatencySpectrogram::update(LfpLatencyProcessor &processor, const LfpLate
     // TODO: Following comments beside variable represent it's original source in visualizer: field variable in class.
     //       But most of them are not used in other places, so potentially some of them can be removed from the class definition.
     int pixelsPerTrack = getImageWidth() / tracksAmount; // LfpLatencyProcessorVisualizer.pixelsPerTrack = SPECTROGRAM_WIDTH / tracksAmount;
-    // #TODO: bmap should be const declared outside of here. otherwise dynamic allocation
-    float bmap[tracksAmount][DATA_CACHE_SIZE_SAMPLES];
+    int draw_imageHeight = getImageHeight();             // LfpLatencyProcessorVisualizer.draw_imageHeight;
+
+    // Window peaks only depend on the subsampling, so tracks that were already drawn are reused
+    if (content.getStartingSample() != cachedStartingSample || content.getSubsamplesPerWindow() != cachedSubsamplesPerWindow || processor.getSamplesPerTrack() != cachedSamplesPerTrack || content.getAveragedView() != cachedAveragedView)
+    {
+        cachedStartingSample = content.getStartingSample();
+        cachedSubsamplesPerWindow = content.getSubsamplesPerWindow();
+        cachedSamplesPerTrack = processor.getSamplesPerTrack();
+        cachedAveragedView = content.getAveragedView();
+        trackBuffer.resize(cachedSamplesPerTrack);
+        std::fill(columnTrack.begin(), columnTrack.end(), -1);
+    }
+
+    auto lastTrack = processor.getLastPublishedTrack();
+    int comboBoxSelectedId = content.getColorStyleComboBoxSelectedId();
     for (int track = 0; track < tracksAmount; track++)
     {
         // Get image dimension
-        int draw_imageHeight = getImageHeight();                           // LfpLatencyProcessorVisualizer.draw_imageHeight;
         int draw_rightHandEdge = getImageWidth() - track * pixelsPerTrack; // LfpLatencyProcessorVisualizer.draw_rightHandEdge;
-        int imageLinePoint = 0;
 
-        // Get data array
-        float *dataToPrint = processor.getdataCacheRow(track);
+        float *peaks = getColumnPeaks(processor, lastTrack - track, track == 0);
 
-        // Reset subsampling flags
-        int samplesAfterStimulus = content.getStartingSample(); // LfpLatencyProcessorVisualizer.samplesAfterStimulus = 0;
-        float lastWindowPeak = 0.0f;                            // LfpLatencyProcessorVisualizer.lastWindowPeak = 0.0f;
-        int windowSampleCount = 0;                              // LfpLatencyProcessorVisualizer.windowSampleCount = 0;
-        for (auto ii = content.getStartingSample(); ii < (DATA_CACHE_SIZE_SAMPLES); ii++)
+        for (int imageLinePoint = 0; imageLinePoint < draw_imageHeight; imageLinePoint++)
         {
-
-            auto sample = dataToPrint[ii];
-
-            // If current sample is larger than previously stored peak, store sample as new peak
-            if (sample > lastWindowPeak)
-            {
-                lastWindowPeak = sample;
-            }
-
-            // Increment window sample counter
-            ++windowSampleCount;
-
-            // If window is full, push window's peak into fifo
-            if (windowSampleCount >= content.getSubsamplesPerWindow()) // 76
+            float lastWindowPeak = peaks[imageLinePoint];
+            float wLevel = (jmap(lastWindowPeak, content.getLowImageThreshold(), content.getHighImageThreshold(), 0.0f, 1.0f)); // LfpLatencyProcessorVisualizer.level;
+            float bLevel = 1.0f - wLevel;
+            bmap[track * draw_imageHeight + imageLinePoint] = wLevel;
+            for (auto jj = 0; jj < pixelsPerTrack; jj++)
             {
-
-                // If fifo not full, store peak into fifo
-                if (imageLinePoint < getImageHeight())
+                int x = draw_rightHandEdge - jj - 1;           // x in [draw_rightHandEdge-pixelsPerTrack, ..., draw_rightHandEdge-1]
+                int y = draw_imageHeight - imageLinePoint - 1; // y in [0, ..., getImageHeight]
+                // Update spectrogram with selected color scheme
+                switch (comboBoxSelectedId)
                 {
-
-                    float wLevel = (jmap(lastWindowPeak, content.getLowImageThreshold(), content.getHighImageThreshold(), 0.0f, 1.0f)); // LfpLatencyProcessorVisualizer.level;
-                    float bLevel = 1.0f - wLevel;
-                    bmap[track][imageLinePoint] = wLevel;
-                    int comboBoxSelectedId = content.getColorStyleComboBoxSelectedId();
-                    for (auto jj = 0; jj < pixelsPerTrack; jj++)
-                    {
-                        int x = draw_rightHandEdge - jj - 1;           // x in [draw_rightHandEdge-pixelsPerTrack, ..., draw_rightHandEdge-1]
-                        int y = draw_imageHeight - imageLinePoint - 1; // y in [0, ..., getImageHeight]
-                        // Update spectrogram with selected color scheme
-                        switch (comboBoxSelectedId)
-                        {
-                        case 1:
-                            // WHOT
-                            drawHot(x, y, lastWindowPeak, content, wLevel);
-                            break;
-                        case 2:
-                            // BHOT
-                            drawHot(x, y, lastWindowPeak, content, bLevel);
-                            break;
-                        case 3:
-                            // WHOT, only grayscale
-                            drawHotGrayScale(x, y, wLevel);
-                            break;
-                        case 4:
-                            // BHOT, only grayscale
-                            drawHotGrayScale(x, y, bLevel);
-                            break;
-                        default:
-                            break;
-                        }
-                    }
-                    // Go to next line
-                    imageLinePoint++;
+                case 1:
+                    // WHOT
+                    drawHot(x, y, lastWindowPeak, content, wLevel);
+                    break;
+                case 2:
+                    // BHOT
+                    drawHot(x, y, lastWindowPeak, content, bLevel);
+                    break;
+                case 3:
+                    // WHOT, only grayscale
+                    drawHotGrayScale(x, y, wLevel);
+                    break;
+                case 4:
+                    // BHOT, only grayscale
+                    drawHotGrayScale(x, y, bLevel);
+                    break;
+                default:
+                    break;
                 }
-                // Reset subsampling flags
-                lastWindowPeak = 0.0f;
-                windowSampleCount = 0;
             }
-
-            samplesAfterStimulus++;
         }
     }
 
     auto detectionThreshold_scaled = jmap(content.getDetectionThreshold(), content.getLowImageThreshold(), content.getHighImageThreshold(), 0.0f, 1.0f);
-    int comboBoxSelectedId = content.getColorStyleComboBoxSelectedId();
     if (comboBoxSelectedId == 5)
     {
 
@@ -210,12 +194,13 @@ void LfpLatencySpectrogram::update(LfpLatencyProcessor &processor, const LfpLate
             path.startNewSubPath(getImageWidth() - ((x + 2) * pixelsPerTrack), getImageHeight());
             for (int y = 0; y < getImageHeight(); y++)
             {
-                auto curX = xOffset + ((1 - bmap[x][y]) * (pixelsPerTrack));
+                auto level = bmap[x * getImageHeight() + y];
+                auto curX = xOffset + ((1 - level) * (pixelsPerTrack));
                 auto curY = getImageHeight() - y;
                 path.lineTo(curX, curY);
 
                 // highlight where threshold crossings occur
-                if ((bmap[x][y]) > detectionThreshold_scaled)
+                if (level > detectionThreshold_scaled)
                 {
                     juce::Path p;
                     p.startNewSubPath(getImageWidth() - ((x + 2) * pixelsPerTrack), curY);
@@ -261,6 +246,70 @@ void LfpLatencySpectrogram::update(LfpLatencyProcessor &processor, const LfpLate
     // g.drawLine(box_x,get<1>(sbl),box_x+pixelsPerTrack,get<1>(sbl));
 }
 
+float *LfpLatencySpectrogram::getColumnPeaks(LfpLatencyProcessor &processor, int64 track, bool newest)
+{
+    int imageHeight = getImageHeight();
+    if (track < 0)
+    {
+        // Nothing recorded yet, draw an empty column
+        std::fill(emptyColumn.begin(), emptyColumn.end(), 0.0f);
+        return emptyColumn.data();
+    }
+
+    auto slot = track % tracksAmount;
+    float *peaks = columnPeaks.data() + slot * imageHeight;
+    // The average may still be catching up with the newest track, so that column is redrawn every tick
+    if (columnTrack[slot] == track && !(cachedAveragedView && newest))
+    {
+        return peaks;
+    }
+
+    // Copy the part of the track that is on screen, then reduce each window to its peak
+    int startSample = jlimit(0, cachedSamplesPerTrack, cachedStartingSample);
+    int subsamplesPerWindow = jmax(1, cachedSubsamplesPerWindow);
+    int numWindows = jmin(imageHeight, (cachedSamplesPerTrack - startSample) / subsamplesPerWindow);
+    if (cachedAveragedView && !newest)
+    {
+        // The average these tracks were part of is gone, leave the column empty
+        std::fill(peaks, peaks + imageHeight, 0.0f);
+        columnTrack[slot] = track;
+        return peaks;
+    }
+    int numValid;
+    if (cachedAveragedView)
+    {
+        numValid = processor.readAverageTrack(startSample, numWindows * subsamplesPerWindow, trackBuffer.data());
+        if (numValid < 0)
+        {
+            // The average was being updated, keep what was drawn and try again on the next tick
+            if (columnTrack[slot] != track)
+            {
+                std::fill(peaks, peaks + imageHeight, 0.0f);
+            }
+            return peaks;
+        }
+    }
+    else
+    {
+        numValid = processor.readPublishedTrack(track, startSample, numWindows * subsamplesPerWindow, trackBuffer.data());
+    }
+    std::fill(peaks, peaks + imageHeight, 0.0f);
+    if (numValid < 0)
+    {
+        // Overwritten before we got to it, leave the column empty rather than draw a torn track
+        columnTrack[slot] = track;
+        return peaks;
+    }
+    // Windows past the end of a short track stay empty
+    for (int imageLinePoint = 0; imageLinePoint * subsamplesPerWindow < numValid; imageLinePoint++)
+    {
+        int windowStart = imageLinePoint * subsamplesPerWindow;
+        peaks[imageLinePoint] = FloatVectorOperations::findMaximum(trackBuffer.data() + windowStart, jmin(subsamplesPerWindow, numValid - windowStart));
+    }
+    columnTrack[slot] = track;
+    return peaks;
+}
+
 void LfpLatencySpectrogram::drawHot(int x, int y, float lastWindowPeak, const LfpLatencyProcessorVisualizerContentComponent &content, float level)
 {
     if (lastWindowPeak > content.getDetectionThreshold() && lastWindowPeak < content.getHighImageThreshold())
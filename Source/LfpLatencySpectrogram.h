@@ -48,6 +48,20 @@ public:
 private:
     Image image;
 
+    std::vector<float> bmap;        // colour level of each drawn window, used by the line view
+    std::vector<float> columnPeaks; // window peaks of the tracks on screen, one column per track
+    std::vector<int64> columnTrack; // the track each column of columnPeaks was computed from
+    std::vector<float> emptyColumn;
+    std::vector<float> trackBuffer; // copy of the track being reduced
+    int cachedStartingSample;
+    int cachedSubsamplesPerWindow;
+    int cachedSamplesPerTrack;
+    bool cachedAveragedView; // columns hold the running average as it was when their track was newest
+
+    /** Returns the window peaks of a published track, reading it from the processor only if not already cached.
+        In averaged view only the newest track can be read, as the average of the tracks up to it */
+    float *getColumnPeaks(LfpLatencyProcessor &processor, int64 track, bool newest);
+
     void paintAll(Colour colour);
     void drawHot(int x, int y, float lastWindowPeak, const LfpLatencyProcessorVisualizerContentComponent &content, float level);
     void drawHotGrayScale(int x, int y, float level);
@@ -62,14 +62,12 @@ LfpLatencySpectrogramControlPanel::LfpLatencySpectrogramControlPanel(LfpLatencyP
     lowImageThreshold->setTextEditorText(String(imageThreshold->getSliderMinimum()) + " uV");
 
     subsamplesPerWindowSlider = new LfpLatencyLabelSlider("Subsamples Per Window");
-    int maxSubsample = std::round(DATA_CACHE_SIZE_SAMPLES / SPECTROGRAM_HEIGHT); // TODO: remove constants
-    subsamplesPerWindowSlider->setSliderRange(1, maxSubsample, 1);
     subsamplesPerWindowSlider->addSliderListener(content);
     subsamplesPerWindowSlider->setSliderValue(content->getSubsamplesPerWindow()); // TODO: not sure we need this for initialisation
 
     startingSampleSlider = new LfpLatencyLabelSlider("Starting Sample");
-    startingSampleSlider->setSliderRange(0, 30000, 1);
     startingSampleSlider->addSliderListener(content);
+    setTrackLength(content->processor->getSamplesPerTrack());
     startingSampleSlider->setSliderValue(content->getStartingSample());
 
     // TODO: conduction distance not used?
@@ -139,6 +137,14 @@ void LfpLatencySpectrogramControlPanel::setLowImageThresholdText(const String &n
     lowImageThreshold->setTextEditorText(newText);
 }
 
+void LfpLatencySpectrogramControlPanel::setTrackLength(int samplesPerTrack)
+{
+    // The whole track should fit on screen at the largest subsampling
+    int maxSubsample = std::max(1, samplesPerTrack / SPECTROGRAM_HEIGHT);
+    subsamplesPerWindowSlider->setSliderRange(1, maxSubsample, 1);
+    startingSampleSlider->setSliderRange(0, samplesPerTrack, 1);
+}
+
 void LfpLatencySpectrogramControlPanel::setStartingSampleValue(double newValue)
 {
     startingSampleSlider->setSliderValue(newValue);
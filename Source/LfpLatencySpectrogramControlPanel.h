@@ -49,6 +49,9 @@ public:
     void setDetectionThresholdText(const String &newText);
     void setLowImageThresholdText(const String &newText);
 
+    /** Limits the starting sample and subsampling sliders to the cached track length */
+    void setTrackLength(int samplesPerTrack);
+
     void setStartingSampleValue(double newValue);
     void setSubsamplesPerWindowValue(double newValue);
     double getSubsamplesPerWindowValue() const;
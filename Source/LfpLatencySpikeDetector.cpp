@@ -0,0 +1,245 @@
+/*
+    ------------------------------------------------------------------
+
+    This file is part of APTrack, a plugin for the Open-Ephys Gui
+
+    Copyright (C) 2019-2023 Eli Lilly and Company, University of Bristol, Open Ephys
+    Authors: Aidan Nickerson, Grace Stangroome, Merle Zhang, James O'Sullivan, Manuel Martinez
+
+    ------------------------------------------------------------------
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include "LfpLatencySpikeDetector.h"
+
+float LfpLatencySpikeDetector::refinePeakLatency(const float *track, int peak, int first, int last)
+{
+    if (peak <= first || peak >= last - 1)
+    {
+        return static_cast<float>(peak);
+    }
+
+    float before = track[peak - 1];
+    float centre = track[peak];
+    float after = track[peak + 1];
+
+    // Vertex of the parabola through the three samples, only meaningful if it opens downwards
+    float curvature = before - 2.0f * centre + after;
+    if (curvature >= 0.0f)
+    {
+        return static_cast<float>(peak);
+    }
+    float offset = 0.5f * (before - after) / curvature;
+
+    // The sample is the maximum of its neighbours, so the vertex is within half a sample of it
+    return peak + jlimit(-0.5f, 0.5f, offset);
+}
+
+void LfpLatencySpikeDetector::updateTemplate(float *waveform, int length, int &tracks, int maxTracks, const float *segment)
+{
+    // Running mean of the first maxTracks segments, an exponential average after that
+    tracks = std::min(tracks + 1, maxTracks);
+    float weight = 1.0f / tracks;
+    for (int n = 0; n < length; n++)
+    {
+        waveform[n] += weight * (segment[n] - waveform[n]);
+    }
+}
+
+LfpLatencySpikeDetector::LfpLatencySpikeDetector()
+    : maxSignalLength(0), maxFFTSize(0)
+{
+    kernel.resize(MAX_SPIKE_TEMPLATE_LENGTH);
+}
+
+void LfpLatencySpikeDetector::prepare(int newMaxSignalLength)
+{
+    if (newMaxSignalLength <= maxSignalLength)
+    {
+        return;
+    }
+    maxSignalLength = newMaxSignalLength;
+    maxFFTSize = nextPowerOfTwo(maxSignalLength);
+
+    scores.resize(maxSignalLength);
+    prefixSum.resize(maxSignalLength + 1);
+    prefixSquares.resize(maxSignalLength + 1);
+    packed.resize(maxFFTSize);
+    product.resize(maxFFTSize);
+    twiddles.resize(maxFFTSize / 2);
+    for (int k = 0; k < maxFFTSize / 2; k++)
+    {
+        twiddles[k] = std::polar(1.0f, static_cast<float>(-MathConstants<double>::twoPi * k / maxFFTSize));
+    }
+}
+
+int LfpLatencySpikeDetector::matchTemplate(const float *signal, int numSamples, const float *waveform, int length, float &score)
+{
+    score = 0.0f;
+    if (length < 2 || length > MAX_SPIKE_TEMPLATE_LENGTH || numSamples < length || numSamples > maxSignalLength)
+    {
+        return -1;
+    }
+
+    // With a zero-mean unit-norm kernel the numerator needs no mean correction
+    float mean = 0.0f;
+    for (int n = 0; n < length; n++)
+    {
+        mean += waveform[n];
+    }
+    mean /= length;
+    float norm = 0.0f;
+    for (int n = 0; n < length; n++)
+    {
+        kernel[n] = waveform[n] - mean;
+        norm += kernel[n] * kernel[n];
+    }
+    if (norm <= std::numeric_limits<float>::min())
+    {
+        // A flat waveform correlates with nothing
+        return -1;
+    }
+    FloatVectorOperations::multiply(kernel.data(), 1.0f / std::sqrt(norm), length);
+
+    // Pick whichever kernel is cheaper for this window
+    int numLags = numSamples - length + 1;
+    int fftSize = nextPowerOfTwo(numSamples);
+    int64 directCost = static_cast<int64>(numLags) * length;
+    int64 fftCost = static_cast<int64>(FFT_CORRELATION_COST) * fftSize * std::max(1, static_cast<int>(std::log2(fftSize)));
+    if (directCost > fftCost)
+    {
+        correlateFFT(signal, numSamples, numLags, length, fftSize);
+    }
+    else
+    {
+        correlateDirect(signal, numLags, length);
+    }
+
+    // Divide by the norm of each zero-mean signal segment
+    prefixSum[0] = 0.0;
+    prefixSquares[0] = 0.0;
+    for (int n = 0; n < numSamples; n++)
+    {
+        prefixSum[n + 1] = prefixSum[n] + signal[n];
+        prefixSquares[n + 1] = prefixSquares[n] + static_cast<double>(signal[n]) * signal[n];
+    }
+    int best = 0;
+    for (int lag = 0; lag < numLags; lag++)
+    {
+        double sum = prefixSum[lag + length] - prefixSum[lag];
+        double energy = prefixSquares[lag + length] - prefixSquares[lag] - sum * sum / length;
+        scores[lag] = energy > 0.0 ? static_cast<float>(scores[lag] / std::sqrt(energy)) : 0.0f;
+        if (scores[lag] > scores[best])
+        {
+            best = lag;
+        }
+    }
+    score = scores[best];
+    return best;
+}
+
+void LfpLatencySpikeDetector::correlateDirect(const float *signal, int numLags, int length)
+{
+    const float *k = kernel.data();
+    for (int lag = 0; lag < numLags; lag++)
+    {
+        // Independent partial sums let the compiler vectorise the reduction
+        const float *x = signal + lag;
+        float acc[8] = {};
+        int n = 0;
+        for (; n + 8 <= length; n += 8)
+        {
+            for (int j = 0; j < 8; j++)
+            {
+                acc[j] += x[n + j] * k[n + j];
+            }
+        }
+        float dot = ((acc[0] + acc[4]) + (acc[1] + acc[5])) + ((acc[2] + acc[6]) + (acc[3] + acc[7]));
+        for (; n < length; n++)
+        {
+            dot += x[n] * k[n];
+        }
+        scores[lag] = dot;
+    }
+}
+
+void LfpLatencySpikeDetector::correlateFFT(const float *signal, int numSamples, int numLags, int length, int fftSize)
+{
+    // Both inputs are real, so one transform of signal + i * kernel gives both spectra
+    for (int n = 0; n < fftSize; n++)
+    {
+        packed[n] = std::complex<float>(n < numSamples ? signal[n] : 0.0f, n < length ? kernel[n] : 0.0f);
+    }
+    fft(packed.data(), fftSize, false);
+
+    // Cross spectrum S * conj(K), with S = (Z[m] + conj(Z[-m])) / 2 and K = (Z[m] - conj(Z[-m])) / 2i
+    for (int m = 0; m < fftSize; m++)
+    {
+        auto z = packed[m];
+        auto zMirror = std::conj(packed[(fftSize - m) & (fftSize - 1)]);
+        auto s = 0.5f * (z + zMirror);
+        auto k = std::complex<float>(0.0f, -0.5f) * (z - zMirror);
+        product[m] = s * std::conj(k);
+    }
+    fft(product.data(), fftSize, true);
+
+    // The signal is no longer than the transform, so offsets up to numLags do not wrap around
+    float scale = 1.0f / fftSize;
+    for (int lag = 0; lag < numLags; lag++)
+    {
+        scores[lag] = product[lag].real() * scale;
+    }
+}
+
+void LfpLatencySpikeDetector::fft(std::complex<float> *data, int size, bool inverse)
+{
+    // Bit reversal permutation
+    for (int i = 1, j = 0; i < size; i++)
+    {
+        int bit = size >> 1;
+        for (; j & bit; bit >>= 1)
+        {
+            j ^= bit;
+        }
+        j ^= bit;
+        if (i < j)
+        {
+            std::swap(data[i], data[j]);
+        }
+    }
+
+    // Butterflies, reading the twiddles of the largest size with a stride
+    for (int span = 2; span <= size; span <<= 1)
+    {
+        int half = span >> 1;
+        int stride = maxFFTSize / span;
+        for (int start = 0; start < size; start += span)
+        {
+            for (int k = 0; k < half; k++)
+            {
+                auto w = twiddles[k * stride];
+                if (inverse)
+                {
+                    w = std::conj(w);
+                }
+                auto a = data[start + k];
+                auto b = data[start + k + half] * w;
+                data[start + k] = a + b;
+                data[start + k + half] = a - b;
+            }
+        }
+    }
+}
@@ -0,0 +1,94 @@
+/*
+    ------------------------------------------------------------------
+
+    This file is part of APTrack, a plugin for the Open-Ephys Gui
+
+    Copyright (C) 2019-2023 Eli Lilly and Company, University of Bristol, Open Ephys
+    Authors: Aidan Nickerson, Grace Stangroome, Merle Zhang, James O'Sullivan, Manuel Martinez
+
+    ------------------------------------------------------------------
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef LFPLATENCYSPIKEDETECTOR_H_INCLUDED
+#define LFPLATENCYSPIKEDETECTOR_H_INCLUDED
+
+#include <ProcessorHeaders.h>
+#include <complex>
+#include <vector>
+
+// Longest averaged spike waveform, in samples
+#define MAX_SPIKE_TEMPLATE_LENGTH 512
+
+// Relative cost of one FFT butterfly against one multiply-add of the direct kernel
+#define FFT_CORRELATION_COST 4
+
+/**
+    Detection helpers for the tracked spike windows.
+
+    Peak refinement works on one cached track row and is cheap enough to run for every group on every track.
+    Template matching scores every alignment of an averaged waveform by normalised cross-correlation, with a
+    direct kernel for short windows and an FFT for wide ones. Scratch space is allocated by prepare(), so
+    matching does not allocate on the audio thread.
+*/
+class LfpLatencySpikeDetector
+{
+public:
+    LfpLatencySpikeDetector();
+
+    /** Refines the latency of the peak at sample peak to sub-sample precision with a parabolic fit
+        through the peak and its two neighbours. Only samples in [first, last) are used, at the edges
+        or on a flat top the integer position is returned. */
+    static float refinePeakLatency(const float *track, int peak, int first, int last);
+
+    /** Adds an aligned segment to the averaged waveform. tracks counts the segments averaged so far,
+        once it reaches maxTracks older segments decay exponentially. */
+    static void updateTemplate(float *waveform, int length, int &tracks, int maxTracks, const float *segment);
+
+    /** Allocates scratch space for signals of up to maxSignalLength samples. Not on the audio thread. */
+    void prepare(int maxSignalLength);
+
+    /** Scores every alignment of waveform within signal by normalised cross-correlation. Returns the offset
+        of the best alignment and stores its score, or returns -1 if there is nothing to match. */
+    int matchTemplate(const float *signal, int numSamples, const float *waveform, int length, float &score);
+
+    /** Scores of the last call to matchTemplate, one per offset */
+    const float *getScores() const { return scores.data(); }
+
+private:
+    /** Dot product of the kernel with every offset of the signal, for few offsets or short kernels */
+    void correlateDirect(const float *signal, int numLags, int length);
+
+    /** The same through one complex FFT of the signal and kernel packed together and one inverse FFT */
+    void correlateFFT(const float *signal, int numSamples, int numLags, int length, int fftSize);
+
+    /** In-place radix-2 FFT of size a power of two up to maxFFTSize */
+    void fft(std::complex<float> *data, int size, bool inverse);
+
+    std::vector<float> kernel;                  // zero-mean, unit-norm copy of the waveform
+    std::vector<float> scores;                  // correlation for each offset
+    std::vector<double> prefixSum;              // running sums of the signal, for the sliding norm
+    std::vector<double> prefixSquares;          // running sums of the squared signal
+    std::vector<std::complex<float>> packed;    // signal + i * kernel and its transform
+    std::vector<std::complex<float>> product;   // cross spectrum and its inverse
+    std::vector<std::complex<float>> twiddles;  // roots of unity for maxFFTSize
+    int maxSignalLength;
+    int maxFFTSize;
+
+    JUCE_DECLARE_NON_COPYABLE(LfpLatencySpikeDetector);
+};
+
+#endif // LFPLATENCYSPIKEDETECTOR_H_INCLUDED
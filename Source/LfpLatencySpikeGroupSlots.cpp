@@ -0,0 +1,157 @@
+/*
+    ------------------------------------------------------------------
+
+    This file is part of APTrack, a plugin for the Open-Ephys Gui
+
+    Copyright (C) 2019-2023 Eli Lilly and Company, University of Bristol, Open Ephys
+    Authors: Aidan Nickerson, Grace Stangroome, Merle Zhang, James O'Sullivan, Manuel Martinez
+
+    ------------------------------------------------------------------
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include "LfpLatencySpikeGroupSlots.h"
+
+LfpLatencySpikeGroupSlots::LfpLatencySpikeGroupSlots(int maxSlots)
+    : generations(maxSlots, 0), positions(maxSlots, -1), liveSlots(maxSlots, -1), retiredAt(maxSlots, 0), freeSlots(maxSlots),
+      numLive(0), firstFree(0), numFree(maxSlots), sequence(0), readerSequence(0), readerActive(false)
+{
+    for (int slot = 0; slot < maxSlots; slot++)
+    {
+        freeSlots[slot] = slot;
+    }
+}
+
+int LfpLatencySpikeGroupSlots::allocate()
+{
+    if (numFree == 0)
+    {
+        return -1;
+    }
+
+    // Slots are freed in sequence order, if the oldest is still in a list the audio thread holds so are the rest
+    int slot = freeSlots[firstFree];
+    uint32_t heldSequence = readerSequence.load(std::memory_order_acquire);
+    if (readerActive.load(std::memory_order_acquire) && static_cast<int32_t>(heldSequence - retiredAt[slot]) < 0)
+    {
+        return -1;
+    }
+    firstFree = (firstFree + 1) % static_cast<int>(freeSlots.size());
+    numFree--;
+    return slot;
+}
+
+SpikeGroupHandle LfpLatencySpikeGroupSlots::publish(int slot)
+{
+    beginChange();
+    positions[slot] = numLive;
+    liveSlots[numLive++] = slot;
+    endChange();
+    return {slot, generations[slot]};
+}
+
+bool LfpLatencySpikeGroupSlots::remove(SpikeGroupHandle handle)
+{
+    int position = getPosition(handle);
+    if (position < 0)
+    {
+        return false;
+    }
+
+    beginChange();
+    int last = liveSlots[--numLive];
+    liveSlots[position] = last;
+    positions[last] = position;
+    positions[handle.slot] = -1;
+    generations[handle.slot]++;
+    endChange();
+
+    retiredAt[handle.slot] = sequence.load(std::memory_order_relaxed);
+    freeSlots[(firstFree + numFree) % static_cast<int>(freeSlots.size())] = handle.slot;
+    numFree++;
+    return true;
+}
+
+int LfpLatencySpikeGroupSlots::getSlot(SpikeGroupHandle handle) const
+{
+    return getPosition(handle) >= 0 ? handle.slot : -1;
+}
+
+int LfpLatencySpikeGroupSlots::getPosition(SpikeGroupHandle handle) const
+{
+    if (handle.slot < 0 || handle.slot >= static_cast<int>(generations.size()) || generations[handle.slot] != handle.generation)
+    {
+        return -1;
+    }
+    return positions[handle.slot];
+}
+
+SpikeGroupHandle LfpLatencySpikeGroupSlots::getHandle(int position) const
+{
+    if (position < 0 || position >= numLive)
+    {
+        return {};
+    }
+    int slot = liveSlots[position];
+    return {slot, generations[slot]};
+}
+
+int LfpLatencySpikeGroupSlots::size() const
+{
+    return numLive;
+}
+
+bool LfpLatencySpikeGroupSlots::isFull() const
+{
+    return numFree == 0;
+}
+
+int LfpLatencySpikeGroupSlots::readLiveSlots(int *dest)
+{
+    // Sequence lock read: the copy is only valid if the list was stable and unchanged throughout
+    uint32_t sequenceBefore = sequence.load(std::memory_order_acquire);
+    if ((sequenceBefore & 1) != 0)
+    {
+        return -1;
+    }
+    int count = numLive;
+    std::copy(liveSlots.begin(), liveSlots.begin() + count, dest);
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (sequence.load(std::memory_order_relaxed) != sequenceBefore)
+    {
+        return -1;
+    }
+    readerSequence.store(sequenceBefore, std::memory_order_release);
+    return count;
+}
+
+void LfpLatencySpikeGroupSlots::setReaderActive(bool active)
+{
+    // A reader starting afresh holds no list yet
+    readerSequence.store(sequence.load(std::memory_order_relaxed), std::memory_order_release);
+    readerActive.store(active, std::memory_order_release);
+}
+
+void LfpLatencySpikeGroupSlots::beginChange()
+{
+    sequence.store(sequence.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+}
+
+void LfpLatencySpikeGroupSlots::endChange()
+{
+    sequence.store(sequence.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+}
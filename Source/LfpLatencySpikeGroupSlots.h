@@ -0,0 +1,102 @@
+/*
+    ------------------------------------------------------------------
+
+    This file is part of APTrack, a plugin for the Open-Ephys Gui
+
+    Copyright (C) 2019-2023 Eli Lilly and Company, University of Bristol, Open Ephys
+    Authors: Aidan Nickerson, Grace Stangroome, Merle Zhang, James O'Sullivan, Manuel Martinez
+
+    ------------------------------------------------------------------
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef LFPLATENCYSPIKEGROUPSLOTS_H_INCLUDED
+#define LFPLATENCYSPIKEGROUPSLOTS_H_INCLUDED
+
+#include <ProcessorHeaders.h>
+#include <atomic>
+#include <vector>
+
+/** Names a spike group for as long as it exists, a removed group's handle stops resolving even if its slot is reused */
+struct SpikeGroupHandle
+{
+    int slot = -1;
+    uint32 generation = 0;
+};
+
+/**
+    Bookkeeping of the slots spike groups are stored in.
+
+    Groups live in a fixed array of slots, so they never move, and are listed in a dense array of slot
+    indices in table order. Adding and removing a group cost the same whatever the number of groups:
+    a removed group's place in the list is taken by the last one and its slot joins a free queue.
+
+    Only one thread changes the slots. The audio thread takes a copy of the list under a sequence lock,
+    and a removed slot is only handed out again once the audio thread has copied a list without it, so
+    a group is never reinitialised while it is being evaluated.
+*/
+class LfpLatencySpikeGroupSlots
+{
+public:
+    LfpLatencySpikeGroupSlots(int maxSlots);
+
+    /** Takes a free slot for a new group, or returns -1 if every slot is live or waiting on the audio thread */
+    int allocate();
+
+    /** Appends an allocated slot to the list once its group is initialised, and returns its handle */
+    SpikeGroupHandle publish(int slot);
+
+    /** Removes a group from the list, returning false if the handle no longer resolves */
+    bool remove(SpikeGroupHandle handle);
+
+    /** Returns the slot of a group, or -1 if it has been removed */
+    int getSlot(SpikeGroupHandle handle) const;
+
+    /** Returns the place of a group in the list, or -1 if it has been removed */
+    int getPosition(SpikeGroupHandle handle) const;
+
+    /** Returns the handle of the group at a place in the list */
+    SpikeGroupHandle getHandle(int position) const;
+
+    int size() const;
+
+    /** Returns true if every slot holds a live group, rather than some waiting on the audio thread */
+    bool isFull() const;
+
+    /** Copies the list for the audio thread, returning the number of slots or -1 if it changed during the copy */
+    int readLiveSlots(int *dest);
+
+    /** Tells whether the audio thread is running, while it is not every removed slot can be reused at once */
+    void setReaderActive(bool active);
+
+private:
+    std::vector<uint32> generations;
+    std::vector<int> positions;     // place of each live slot in the list
+    std::vector<int> liveSlots;     // slots in table order, the first numLive are in use
+    std::vector<uint32> retiredAt;  // list sequence a slot was removed at
+    std::vector<int> freeSlots;     // ring of slots waiting to be reused, oldest first
+    int numLive;
+    int firstFree;
+    int numFree;
+    std::atomic<uint32_t> sequence; // odd while the list is being changed
+    std::atomic<uint32_t> readerSequence; // sequence of the last list the audio thread copied
+    std::atomic<bool> readerActive;
+
+    void beginChange();
+    void endChange();
+};
+
+#endif // LFPLATENCYSPIKEGROUPSLOTS_H_INCLUDED
@@ -0,0 +1,199 @@
+/*
+    ------------------------------------------------------------------
+
+    This file is part of APTrack, a plugin for the Open-Ephys Gui
+
+    Copyright (C) 2019-2023 Eli Lilly and Company, University of Bristol, Open Ephys
+    Authors: Aidan Nickerson, Grace Stangroome, Merle Zhang, James O'Sullivan, Manuel Martinez
+
+    ------------------------------------------------------------------
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include "LfpLatencySpikeSerializer.h"
+#include "LfpLatencyProcessor.h"
+#include <sstream>
+
+LfpLatencySpikeSerializer::LfpLatencySpikeSerializer()
+    : Thread("APTrack spike serializer"), fifo(SPIKE_RECORD_CAPACITY), records(SPIKE_RECORD_CAPACITY),
+      messageFifo(SPIKE_MESSAGE_CAPACITY), messages(SPIKE_MESSAGE_CAPACITY), droppedRecords(0), droppedMessages(0)
+{
+    currentTrackSpikes.reserve(MAX_SPIKE_GROUPS);
+}
+
+LfpLatencySpikeSerializer::~LfpLatencySpikeSerializer()
+{
+    stopThread(1000);
+}
+
+void LfpLatencySpikeSerializer::start()
+{
+    stop();
+    fifo.reset();
+    messageFifo.reset();
+    currentTrackSpikes.clear();
+    droppedRecords = 0;
+    droppedMessages = 0;
+    startThread();
+}
+
+void LfpLatencySpikeSerializer::stop()
+{
+    stopThread(1000);
+
+    // The last track may not have been closed
+    serializePending();
+    sendTrack();
+    if (droppedRecords > 0)
+    {
+        std::cout << "Spike serializer dropped " << droppedRecords << " records" << std::endl;
+        droppedRecords = 0;
+    }
+    if (droppedMessages > 0)
+    {
+        std::cout << "Spike serializer dropped " << droppedMessages << " messages" << std::endl;
+        droppedMessages = 0;
+    }
+}
+
+void LfpLatencySpikeSerializer::push(const SpikeInfo &spike, int spikeGroup)
+{
+    SpikeRecord record;
+    record.spikeSampleNumber = spike.spikeSampleNumber;
+    record.spikeSampleLatency = spike.spikeSampleLatency;
+    record.spikeLatencyFine = spike.spikeLatencyFine;
+    record.spikePeakValue = spike.spikePeakValue;
+    record.windowSize = spike.windowSize;
+    record.threshold = spike.threshold;
+    record.stimulusVoltage = spike.stimulusVoltage;
+    record.trackIndex = spike.trackIndex;
+    record.channel = spike.channel;
+    record.detectionSource = spike.detectionSource;
+    record.spikeGroup = spikeGroup;
+    pushRecord(record);
+}
+
+void LfpLatencySpikeSerializer::endTrack(int trackIndex)
+{
+    SpikeRecord record = {};
+    record.trackIndex = trackIndex;
+    record.spikeGroup = -1;
+    pushRecord(record);
+}
+
+void LfpLatencySpikeSerializer::pushRecord(const SpikeRecord &record)
+{
+    if (fifo.getFreeSpace() == 0)
+    {
+        droppedRecords++;
+        return;
+    }
+    int start1, size1, start2, size2;
+    fifo.prepareToWrite(1, start1, size1, start2, size2);
+    records[start1] = record;
+    fifo.finishedWrite(1);
+}
+
+bool LfpLatencySpikeSerializer::popMessage(std::string &dest)
+{
+    if (messageFifo.getNumReady() == 0)
+    {
+        return false;
+    }
+    int start1, size1, start2, size2;
+    messageFifo.prepareToRead(1, start1, size1, start2, size2);
+    dest.swap(messages[start1]);
+    messageFifo.finishedRead(1);
+    return true;
+}
+
+void LfpLatencySpikeSerializer::run()
+{
+    while (!threadShouldExit())
+    {
+        serializePending();
+        wait(10);
+    }
+}
+
+void LfpLatencySpikeSerializer::serializePending()
+{
+    int numReady = fifo.getNumReady();
+    if (numReady == 0)
+    {
+        return;
+    }
+
+    int start1, size1, start2, size2;
+    fifo.prepareToRead(numReady, start1, size1, start2, size2);
+    for (int i = 0; i < size1 + size2; i++)
+    {
+        const auto &r = records[i < size1 ? start1 + i : start2 + i - size1];
+        if (r.spikeGroup < 0)
+        {
+            sendTrack();
+        }
+        else
+        {
+            currentTrackSpikes.push_back(r);
+        }
+    }
+    fifo.finishedRead(size1 + size2);
+}
+
+void LfpLatencySpikeSerializer::sendTrack()
+{
+    if (currentTrackSpikes.empty())
+    {
+        return;
+    }
+
+    std::stringstream json_out;
+    json_out << "[";
+    for (auto s = currentTrackSpikes.begin(); s != currentTrackSpikes.end(); s++)
+    {
+        if (s != currentTrackSpikes.begin())
+        {
+            json_out << ", ";
+        }
+        json_out << "{"
+                 << "\"spikeSampleLatency\":" << s->spikeSampleLatency
+                 << ", \"spikeLatencyFine\":" << s->spikeLatencyFine
+                 << ", \"windowSize\":" << s->windowSize
+                 << ", \"threshold\":" << s->threshold
+                 << ", \"stimulusVoltage\":" << s->stimulusVoltage
+                 << ", \"spikePeakValue\":" << s->spikePeakValue
+                 << ", \"spikeSampleNumber\":" << s->spikeSampleNumber
+                 << ", \"trackIndex\":" << s->trackIndex
+                 << ", \"channel\":" << s->channel
+                 << ", \"detectionSource\":" << s->detectionSource
+                 << ", \"spikeGroup\":" << s->spikeGroup
+                 << "}";
+    }
+    json_out << "]";
+    currentTrackSpikes.clear();
+
+    // Broadcasting is left to the audio thread, the only thread the message center reads from
+    if (messageFifo.getFreeSpace() == 0)
+    {
+        droppedMessages++;
+        return;
+    }
+    int start1, size1, start2, size2;
+    messageFifo.prepareToWrite(1, start1, size1, start2, size2);
+    messages[start1].assign(json_out.str());
+    messageFifo.finishedWrite(1);
+}
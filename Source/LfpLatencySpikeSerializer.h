@@ -0,0 +1,110 @@
+/*
+    ------------------------------------------------------------------
+
+    This file is part of APTrack, a plugin for the Open-Ephys Gui
+
+    Copyright (C) 2019-2023 Eli Lilly and Company, University of Bristol, Open Ephys
+    Authors: Aidan Nickerson, Grace Stangroome, Merle Zhang, James O'Sullivan, Manuel Martinez
+
+    ------------------------------------------------------------------
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef LFPLATENCYSPIKESERIALIZER_H_INCLUDED
+#define LFPLATENCYSPIKESERIALIZER_H_INCLUDED
+
+#include <ProcessorHeaders.h>
+#include <atomic>
+#include <string>
+#include <vector>
+
+// Number of spike records that can wait for the serializer thread
+#define SPIKE_RECORD_CAPACITY 4096
+
+// Number of finished messages that can wait for the audio thread
+#define SPIKE_MESSAGE_CAPACITY 64
+
+struct SpikeInfo;
+
+/** Fixed-size record of one detection, copied into the ring by the audio thread */
+struct SpikeRecord
+{
+    int64 spikeSampleNumber;
+    int spikeSampleLatency;
+    float spikeLatencyFine;
+    float spikePeakValue;
+    int windowSize;
+    float threshold;
+    float stimulusVoltage;
+    int trackIndex;
+    int channel;
+    int detectionSource;
+    int spikeGroup; // -1 marks the end of a track
+};
+
+/**
+    Turns spike detections into JSON messages off the audio thread.
+
+    The audio thread pushes binary records into a preallocated lock-free ring and closes each track with
+    endTrack(). A background thread serializes the records of a track into one message, a JSON array with
+    one object per spike, and hands it back through a second ring for the audio thread to broadcast.
+*/
+class LfpLatencySpikeSerializer : public Thread
+{
+public:
+    LfpLatencySpikeSerializer();
+    ~LfpLatencySpikeSerializer();
+
+    /** Starts the serializer thread. Call before acquisition starts. */
+    void start();
+
+    /** Stops the serializer thread and serializes whatever is left. Call after acquisition stops.
+        Messages the audio thread has not broadcast by then, usually those of the last track, are dropped. */
+    void stop();
+
+    /** Queues a detection without blocking. Audio thread only. */
+    void push(const SpikeInfo &spike, int spikeGroup);
+
+    /** Marks the end of the spikes of a track, so they are sent together. Audio thread only. */
+    void endTrack(int trackIndex);
+
+    /** Swaps the oldest finished message into dest. Returns false if there is none. Audio thread only. */
+    bool popMessage(std::string &dest);
+
+    void run() override;
+
+private:
+    /** Queues a record, counting it as dropped if the ring is full */
+    void pushRecord(const SpikeRecord &record);
+
+    /** Serializes every queued record, sending a message for each completed track */
+    void serializePending();
+
+    /** Queues a message with the spikes collected for the current track, if any */
+    void sendTrack();
+
+    AbstractFifo fifo;
+    std::vector<SpikeRecord> records;
+    std::vector<SpikeRecord> currentTrackSpikes; // serializer thread only
+    AbstractFifo messageFifo;
+    std::vector<std::string> messages; // strings keep their capacity as they are swapped in and out
+    std::atomic<int> droppedRecords;
+    std::atomic<int> droppedMessages;
+
+    JUCE_DECLARE_NON_COPYABLE(LfpLatencySpikeSerializer);
+};
+
+#endif // LFPLATENCYSPIKESERIALIZER_H_INCLUDED
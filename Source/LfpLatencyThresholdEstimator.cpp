@@ -0,0 +1,214 @@
+/*
+    ------------------------------------------------------------------
+
+    This file is part of APTrack, a plugin for the Open-Ephys Gui
+
+    Copyright (C) 2019-2023 Eli Lilly and Company, University of Bristol, Open Ephys
+    Authors: Aidan Nickerson, Grace Stangroome, Merle Zhang, James O'Sullivan, Manuel Martinez
+
+    ------------------------------------------------------------------
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include "LfpLatencyThresholdEstimator.h"
+
+#define THRESHOLD_GRID_SIZE (THRESHOLD_GRID_THRESHOLDS * THRESHOLD_GRID_SLOPES)
+
+LfpLatencyThresholdEstimator::LfpLatencyThresholdEstimator(int maxFibres)
+    : thresholds(THRESHOLD_GRID_THRESHOLDS), slopes(THRESHOLD_GRID_SLOPES), voltages(THRESHOLD_GRID_VOLTAGES),
+      posterior(static_cast<size_t>(maxFibres) * THRESHOLD_GRID_SIZE), logPosterior(static_cast<size_t>(maxFibres) * THRESHOLD_GRID_SIZE), numStimuli(maxFibres),
+      fireTable(THRESHOLD_GRID_VOLTAGES * THRESHOLD_GRID_SIZE), logFireTable(THRESHOLD_GRID_VOLTAGES * THRESHOLD_GRID_SIZE), logMissTable(THRESHOLD_GRID_VOLTAGES * THRESHOLD_GRID_SIZE),
+      minVoltage(0), maxVoltage(-1)
+{
+}
+
+void LfpLatencyThresholdEstimator::reset(float newMinVoltage, float newMaxVoltage)
+{
+    minVoltage = newMinVoltage;
+    maxVoltage = newMaxVoltage;
+    float range = jmax(1.0e-3f, maxVoltage - minVoltage);
+    for (int t = 0; t < THRESHOLD_GRID_THRESHOLDS; t++)
+    {
+        thresholds[t] = minVoltage + range * t / (THRESHOLD_GRID_THRESHOLDS - 1);
+    }
+    for (int v = 0; v < THRESHOLD_GRID_VOLTAGES; v++)
+    {
+        voltages[v] = minVoltage + range * v / (THRESHOLD_GRID_VOLTAGES - 1);
+    }
+    // Slopes are spaced evenly on a log scale, as how sharp the threshold is is unknown by orders of magnitude
+    for (int s = 0; s < THRESHOLD_GRID_SLOPES; s++)
+    {
+        slopes[s] = THRESHOLD_MIN_SLOPE * std::pow(THRESHOLD_MAX_SLOPE / THRESHOLD_MIN_SLOPE, static_cast<float>(s) / (THRESHOLD_GRID_SLOPES - 1)) / range;
+    }
+
+    for (int v = 0; v < THRESHOLD_GRID_VOLTAGES; v++)
+    {
+        for (int t = 0; t < THRESHOLD_GRID_THRESHOLDS; t++)
+        {
+            for (int s = 0; s < THRESHOLD_GRID_SLOPES; s++)
+            {
+                int cell = v * THRESHOLD_GRID_SIZE + t * THRESHOLD_GRID_SLOPES + s;
+                fireTable[cell] = fireProbability(voltages[v], thresholds[t], slopes[s]);
+                logFireTable[cell] = std::log(fireTable[cell]);
+                logMissTable[cell] = std::log(1.0f - fireTable[cell]);
+            }
+        }
+    }
+
+    for (int fibre = 0; fibre < static_cast<int>(numStimuli.size()); fibre++)
+    {
+        resetFibre(fibre);
+    }
+}
+
+bool LfpLatencyThresholdEstimator::covers(float newMinVoltage, float newMaxVoltage) const
+{
+    return newMinVoltage == minVoltage && newMaxVoltage == maxVoltage;
+}
+
+void LfpLatencyThresholdEstimator::resetFibre(int fibre)
+{
+    float *fibrePosterior = posterior.data() + fibre * THRESHOLD_GRID_SIZE;
+    float *fibreLogPosterior = logPosterior.data() + fibre * THRESHOLD_GRID_SIZE;
+    std::fill(fibrePosterior, fibrePosterior + THRESHOLD_GRID_SIZE, 1.0f / THRESHOLD_GRID_SIZE);
+    std::fill(fibreLogPosterior, fibreLogPosterior + THRESHOLD_GRID_SIZE, -std::log(static_cast<float>(THRESHOLD_GRID_SIZE)));
+    numStimuli[fibre] = 0;
+}
+
+void LfpLatencyThresholdEstimator::update(int fibre, float voltage, bool fired)
+{
+    // The stimulus may fall between candidate voltages, so the likelihood is interpolated from the two nearest
+    float position = jlimit(0.0f, static_cast<float>(THRESHOLD_GRID_VOLTAGES - 1),
+                            (voltage - minVoltage) / jmax(1.0e-3f, maxVoltage - minVoltage) * (THRESHOLD_GRID_VOLTAGES - 1));
+    int below = jmin(static_cast<int>(position), THRESHOLD_GRID_VOLTAGES - 2);
+    float above = position - below;
+    const float *fireBelow = fireTable.data() + below * THRESHOLD_GRID_SIZE;
+    const float *fireAbove = fireBelow + THRESHOLD_GRID_SIZE;
+    const float *logBelow = (fired ? logFireTable : logMissTable).data() + below * THRESHOLD_GRID_SIZE;
+    const float *logAbove = logBelow + THRESHOLD_GRID_SIZE;
+
+    float *fibrePosterior = posterior.data() + fibre * THRESHOLD_GRID_SIZE;
+    float *fibreLogPosterior = logPosterior.data() + fibre * THRESHOLD_GRID_SIZE;
+    float total = 0;
+    for (int cell = 0; cell < THRESHOLD_GRID_SIZE; cell++)
+    {
+        float p = fireBelow[cell] + above * (fireAbove[cell] - fireBelow[cell]);
+        fibrePosterior[cell] *= fired ? p : 1.0f - p;
+        fibreLogPosterior[cell] += logBelow[cell] + above * (logAbove[cell] - logBelow[cell]);
+        total += fibrePosterior[cell];
+    }
+    // The lapse and false-detection rates keep every likelihood above zero, so the logarithms stay finite and
+    // only the normalisation needs one
+    float scale = 1.0f / total;
+    float logScale = std::log(scale);
+    for (int cell = 0; cell < THRESHOLD_GRID_SIZE; cell++)
+    {
+        fibrePosterior[cell] *= scale;
+        fibreLogPosterior[cell] += logScale;
+    }
+    numStimuli[fibre]++;
+}
+
+float LfpLatencyThresholdEstimator::getNextVoltage(const int *fibres, int numFibres) const
+{
+    // Information about different fibres adds up, so the voltage with the least total expected entropy wins
+    float nextVoltage = voltages[THRESHOLD_GRID_VOLTAGES / 2];
+    float bestEntropy = std::numeric_limits<float>::max();
+    for (int v = 0; v < THRESHOLD_GRID_VOLTAGES && numFibres > 0; v++)
+    {
+        float entropy = 0;
+        for (int f = 0; f < numFibres; f++)
+        {
+            entropy += expectedEntropy(fibres[f], v);
+        }
+        if (entropy < bestEntropy)
+        {
+            bestEntropy = entropy;
+            nextVoltage = voltages[v];
+        }
+    }
+    return nextVoltage;
+}
+
+float LfpLatencyThresholdEstimator::getThreshold(int fibre) const
+{
+    const float *fibrePosterior = posterior.data() + fibre * THRESHOLD_GRID_SIZE;
+    float mean = 0;
+    for (int t = 0; t < THRESHOLD_GRID_THRESHOLDS; t++)
+    {
+        for (int s = 0; s < THRESHOLD_GRID_SLOPES; s++)
+        {
+            mean += fibrePosterior[t * THRESHOLD_GRID_SLOPES + s] * thresholds[t];
+        }
+    }
+    return mean;
+}
+
+float LfpLatencyThresholdEstimator::getThresholdSpread(int fibre) const
+{
+    const float *fibrePosterior = posterior.data() + fibre * THRESHOLD_GRID_SIZE;
+    float mean = getThreshold(fibre);
+    float variance = 0;
+    for (int t = 0; t < THRESHOLD_GRID_THRESHOLDS; t++)
+    {
+        for (int s = 0; s < THRESHOLD_GRID_SLOPES; s++)
+        {
+            variance += fibrePosterior[t * THRESHOLD_GRID_SLOPES + s] * (thresholds[t] - mean) * (thresholds[t] - mean);
+        }
+    }
+    return std::sqrt(variance);
+}
+
+int LfpLatencyThresholdEstimator::getNumStimuli(int fibre) const
+{
+    return numStimuli[fibre];
+}
+
+float LfpLatencyThresholdEstimator::fireProbability(float voltage, float threshold, float slope)
+{
+    return THRESHOLD_FALSE_RATE + (1.0f - THRESHOLD_FALSE_RATE - THRESHOLD_LAPSE_RATE) / (1.0f + std::exp(-slope * (voltage - threshold)));
+}
+
+float LfpLatencyThresholdEstimator::expectedEntropy(int fibre, int v) const
+{
+    // With q = posterior * likelihood for an outcome of probability P, the entropy of the updated posterior q / P
+    // is log P - sum(q log q) / P, and log q is the sum of two tabulated logarithms
+    const float *fibrePosterior = posterior.data() + fibre * THRESHOLD_GRID_SIZE;
+    const float *fibreLogPosterior = logPosterior.data() + fibre * THRESHOLD_GRID_SIZE;
+    const float *fire = fireTable.data() + v * THRESHOLD_GRID_SIZE;
+    const float *logFire = logFireTable.data() + v * THRESHOLD_GRID_SIZE;
+    const float *logMiss = logMissTable.data() + v * THRESHOLD_GRID_SIZE;
+    float pFire = 0, fireSum = 0, missSum = 0;
+    for (int cell = 0; cell < THRESHOLD_GRID_SIZE; cell++)
+    {
+        float qFire = fibrePosterior[cell] * fire[cell];
+        float qMiss = fibrePosterior[cell] - qFire;
+        pFire += qFire;
+        fireSum += qFire * (fibreLogPosterior[cell] + logFire[cell]);
+        missSum += qMiss * (fibreLogPosterior[cell] + logMiss[cell]);
+    }
+    float pMiss = 1.0f - pFire;
+    float entropy = 0;
+    if (pFire > 0)
+    {
+        entropy += pFire * std::log(pFire) - fireSum;
+    }
+    if (pMiss > 0)
+    {
+        entropy += pMiss * std::log(pMiss) - missSum;
+    }
+    return entropy;
+}
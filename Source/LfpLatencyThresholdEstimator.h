@@ -0,0 +1,101 @@
+/*
+    ------------------------------------------------------------------
+
+    This file is part of APTrack, a plugin for the Open-Ephys Gui
+
+    Copyright (C) 2019-2023 Eli Lilly and Company, University of Bristol, Open Ephys
+    Authors: Aidan Nickerson, Grace Stangroome, Merle Zhang, James O'Sullivan, Manuel Martinez
+
+    ------------------------------------------------------------------
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef LFPLATENCYTHRESHOLDESTIMATOR_H_INCLUDED
+#define LFPLATENCYTHRESHOLDESTIMATOR_H_INCLUDED
+
+#include <ProcessorHeaders.h>
+#include <vector>
+
+#define THRESHOLD_GRID_THRESHOLDS 64 // candidate thresholds across the stimulus voltage range
+#define THRESHOLD_GRID_SLOPES 8      // candidate slopes of the firing probability
+#define THRESHOLD_GRID_VOLTAGES 32   // voltages the next stimulus is picked from
+#define THRESHOLD_MIN_SLOPE 4.0f     // shallowest and steepest slopes, in logistic units per voltage range
+#define THRESHOLD_MAX_SLOPE 400.0f
+#define THRESHOLD_LAPSE_RATE 0.02f   // chance of missing a spike well above threshold
+#define THRESHOLD_FALSE_RATE 0.02f   // chance of detecting noise well below threshold
+
+/**
+    Bayesian estimate of the stimulus voltage fibres fire at half the time, with the Psi method.
+
+    The firing probability of each fibre is modelled as a logistic function of the stimulus voltage with unknown
+    threshold and slope. A posterior over a grid of both is kept per fibre and updated with every stimulus, and
+    the next voltage is the one whose outcome is expected to leave the posteriors with the least total entropy,
+    so each stimulus goes where it teaches the most about all the fibres being tracked. The likelihoods and
+    their logarithms are tabulated on reset and shared by the fibres, so updating a posterior and choosing the
+    next voltage are multiply-add passes over the grid, and all storage is allocated up front.
+*/
+class LfpLatencyThresholdEstimator
+{
+public:
+    LfpLatencyThresholdEstimator(int maxFibres);
+
+    /** Tabulates the likelihoods for thresholds in [minVoltage, maxVoltage] and restarts every fibre */
+    void reset(float minVoltage, float maxVoltage);
+
+    /** Returns true if the estimator was reset for this voltage range */
+    bool covers(float minVoltage, float maxVoltage) const;
+
+    /** Starts a fibre again from a flat posterior */
+    void resetFibre(int fibre);
+
+    /** Adds the outcome of a stimulus for one fibre */
+    void update(int fibre, float voltage, bool fired);
+
+    /** Returns the voltage whose outcome is expected to teach the most about the listed fibres together */
+    float getNextVoltage(const int *fibres, int numFibres) const;
+
+    /** Returns the posterior mean of the 50% threshold of a fibre */
+    float getThreshold(int fibre) const;
+
+    /** Returns the posterior standard deviation of the 50% threshold of a fibre */
+    float getThresholdSpread(int fibre) const;
+
+    /** Returns the number of stimuli since the fibre was last reset */
+    int getNumStimuli(int fibre) const;
+
+private:
+    /** Probability of a detection for the logistic with a given threshold and slope */
+    static float fireProbability(float voltage, float threshold, float slope);
+
+    /** Returns the expected entropy of the posterior of a fibre after a stimulus at candidate voltage v */
+    float expectedEntropy(int fibre, int v) const;
+
+    std::vector<float> thresholds;
+    std::vector<float> slopes;
+    std::vector<float> voltages;
+    std::vector<float> posterior;    // per fibre, threshold-major, normalised
+    std::vector<float> logPosterior;
+    std::vector<int> numStimuli;
+    std::vector<float> fireTable;    // detection probability per voltage, threshold and slope
+    std::vector<float> logFireTable;
+    std::vector<float> logMissTable;
+    float minVoltage;
+    float maxVoltage;
+
+    JUCE_DECLARE_NON_COPYABLE(LfpLatencyThresholdEstimator);
+};
+
+#endif // LFPLATENCYTHRESHOLDESTIMATOR_H_INCLUDED
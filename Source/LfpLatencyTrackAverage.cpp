@@ -0,0 +1,156 @@
+/*
+    ------------------------------------------------------------------
+
+    This file is part of APTrack, a plugin for the Open-Ephys Gui
+
+    Copyright (C) 2019-2023 Eli Lilly and Company, University of Bristol, Open Ephys
+    Authors: Aidan Nickerson, Grace Stangroome, Merle Zhang, James O'Sullivan, Manuel Martinez
+
+    ------------------------------------------------------------------
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include "LfpLatencyTrackAverage.h"
+
+LfpLatencyTrackAverage::LfpLatencyTrackAverage()
+    : numChannels(0), samplesPerTrack(0), numTracks(1), firstTrack(-1), lastTrack(-1), sequence(0), numAveraged(0)
+{
+}
+
+void LfpLatencyTrackAverage::allocate(int newNumChannels, int newSamplesPerTrack)
+{
+    numChannels = jmax(0, newNumChannels);
+    samplesPerTrack = jmax(0, newSamplesPerTrack);
+    sums.assign(static_cast<size_t>(numChannels) * samplesPerTrack, 0.0f);
+    counts.assign(samplesPerTrack, 0.0f);
+    firstTrack = -1;
+    lastTrack = -1;
+    numAveraged = 0;
+}
+
+void LfpLatencyTrackAverage::setNumTracks(int newNumTracks)
+{
+    newNumTracks = jmax(1, newNumTracks);
+    if (newNumTracks != numTracks)
+    {
+        numTracks = newNumTracks;
+        clear();
+    }
+}
+
+int LfpLatencyTrackAverage::getNumAveraged() const
+{
+    return numAveraged.load(std::memory_order_relaxed);
+}
+
+void LfpLatencyTrackAverage::addTrack(LfpLatencyTrackCache &cache, int64 track)
+{
+    if (samplesPerTrack != cache.getSamplesPerTrack() || numChannels != cache.getNumChannels())
+    {
+        return;
+    }
+
+    // Readers must not trust the sums until they are consistent again
+    sequence.store(sequence.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    // Tracks are averaged in order, after a gap the old ones may be gone from the cache
+    if (lastTrack < 0 || track != lastTrack + 1)
+    {
+        std::fill(sums.begin(), sums.end(), 0.0f);
+        std::fill(counts.begin(), counts.end(), 0.0f);
+        firstTrack = track;
+    }
+    accumulate(cache, track, 1.0f);
+    lastTrack = track;
+
+    while (lastTrack - firstTrack + 1 > numTracks)
+    {
+        if (cache.getMetadata(firstTrack).track == firstTrack)
+        {
+            accumulate(cache, firstTrack, -1.0f);
+        }
+        firstTrack++;
+    }
+    numAveraged.store(static_cast<int>(lastTrack - firstTrack + 1), std::memory_order_relaxed);
+
+    sequence.store(sequence.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+}
+
+void LfpLatencyTrackAverage::accumulate(LfpLatencyTrackCache &cache, int64 track, float sign)
+{
+    int length = jmin(samplesPerTrack, cache.getMetadata(track).validLength);
+    for (int channel = 0; channel < numChannels; channel++)
+    {
+        float *sum = sums.data() + static_cast<size_t>(channel) * samplesPerTrack;
+        if (sign > 0)
+        {
+            FloatVectorOperations::add(sum, cache.getRow(channel, track), length);
+        }
+        else
+        {
+            FloatVectorOperations::subtract(sum, cache.getRow(channel, track), length);
+        }
+    }
+    FloatVectorOperations::add(counts.data(), sign, length);
+}
+
+void LfpLatencyTrackAverage::clear()
+{
+    sequence.store(sequence.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    std::fill(sums.begin(), sums.end(), 0.0f);
+    std::fill(counts.begin(), counts.end(), 0.0f);
+    firstTrack = -1;
+    lastTrack = -1;
+    numAveraged = 0;
+    sequence.store(sequence.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+}
+
+int LfpLatencyTrackAverage::readMean(int channel, float *dest) const
+{
+    return divide(channel, 0, samplesPerTrack, dest);
+}
+
+int LfpLatencyTrackAverage::readAverage(int channel, int startSample, int numSamples, float *dest) const
+{
+    uint32_t sequenceBefore = sequence.load(std::memory_order_acquire);
+    if ((sequenceBefore & 1) != 0)
+    {
+        return -1;
+    }
+    int numValid = divide(channel, startSample, numSamples, dest);
+    std::atomic_thread_fence(std::memory_order_acquire);
+    return sequence.load(std::memory_order_relaxed) == sequenceBefore ? numValid : -1;
+}
+
+int LfpLatencyTrackAverage::divide(int channel, int startSample, int numSamples, float *dest) const
+{
+    if (channel < 0 || channel >= numChannels || startSample < 0 || numSamples < 0 || startSample + numSamples > samplesPerTrack)
+    {
+        return 0;
+    }
+
+    // Every track covers a prefix of the row, so the counts never increase along it
+    const float *sum = sums.data() + static_cast<size_t>(channel) * samplesPerTrack + startSample;
+    const float *count = counts.data() + startSample;
+    int n = 0;
+    for (; n < numSamples && count[n] > 0.5f; n++)
+    {
+        dest[n] = sum[n] / count[n];
+    }
+    return n;
+}
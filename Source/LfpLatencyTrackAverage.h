@@ -0,0 +1,93 @@
+/*
+    ------------------------------------------------------------------
+
+    This file is part of APTrack, a plugin for the Open-Ephys Gui
+
+    Copyright (C) 2019-2023 Eli Lilly and Company, University of Bristol, Open Ephys
+    Authors: Aidan Nickerson, Grace Stangroome, Merle Zhang, James O'Sullivan, Manuel Martinez
+
+    ------------------------------------------------------------------
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef LFPLATENCYTRACKAVERAGE_H_INCLUDED
+#define LFPLATENCYTRACKAVERAGE_H_INCLUDED
+
+#include <ProcessorHeaders.h>
+#include <atomic>
+#include <vector>
+#include "LfpLatencyTrackCache.h"
+
+/**
+    Running average of the most recent published tracks of every cache channel.
+
+    The audio thread adds each track as it is published and subtracts the one leaving the window, so the cost
+    per stimulus is one pass over the track whatever the number of tracks averaged. Tracks cut short by the
+    next stimulus only count towards the samples they cover. Other threads copy the average through
+    readAverage(), which never blocks the writer.
+*/
+class LfpLatencyTrackAverage
+{
+public:
+    LfpLatencyTrackAverage();
+
+    /** Allocates the running sums and forgets the average. Must not be called while the audio thread is writing. */
+    void allocate(int numChannels, int samplesPerTrack);
+
+    /** Changes the number of tracks averaged, restarting the average if it differs. Audio thread only.
+        The tracks leaving the window are read back from the cache, so it must hold more than numTracks tracks. */
+    void setNumTracks(int numTracks);
+
+    /** Returns the number of tracks currently in the average */
+    int getNumAveraged() const;
+
+    /** Adds a track that has just been published and subtracts the one leaving the window. Audio thread only. */
+    void addTrack(LfpLatencyTrackCache &cache, int64 track);
+
+    /** Writes the average of a channel to dest, returns the number of samples covered by at least one track. Audio thread only. */
+    int readMean(int channel, float *dest) const;
+
+    /**
+     Copies the average of one channel in [startSample, startSample + numSamples)
+     - Returns: the number of samples copied, which stops short where no averaged track reaches,
+       or -1 if the average changed during the copy, dest is then undefined
+     */
+    int readAverage(int channel, int startSample, int numSamples, float *dest) const;
+
+private:
+    /** Adds (sign 1) or subtracts (sign -1) a track from the sums */
+    void accumulate(LfpLatencyTrackCache &cache, int64 track, float sign);
+
+    /** Clears the sums */
+    void clear();
+
+    /** Divides the sums of a channel in [startSample, startSample + numSamples) by their counts */
+    int divide(int channel, int startSample, int numSamples, float *dest) const;
+
+    std::vector<float> sums;   // channel-major, samplesPerTrack per channel
+    std::vector<float> counts; // tracks covering each sample, shared by all channels
+    int numChannels;
+    int samplesPerTrack;
+    int numTracks;
+    int64 firstTrack; // oldest track in the average, -1 when empty
+    int64 lastTrack;
+    std::atomic<uint32_t> sequence; // odd while the audio thread is changing the sums
+    std::atomic<int> numAveraged;
+
+    JUCE_DECLARE_NON_COPYABLE(LfpLatencyTrackAverage);
+};
+
+#endif // LFPLATENCYTRACKAVERAGE_H_INCLUDED
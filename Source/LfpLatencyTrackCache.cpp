@@ -0,0 +1,162 @@
+/*
+    ------------------------------------------------------------------
+
+    This file is part of APTrack, a plugin for the Open-Ephys Gui
+
+    Copyright (C) 2019-2023 Eli Lilly and Company, University of Bristol, Open Ephys
+    Authors: Aidan Nickerson, Grace Stangroome, Merle Zhang, James O'Sullivan, Manuel Martinez
+
+    ------------------------------------------------------------------
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include "LfpLatencyTrackCache.h"
+#include <cstring>
+#include <new>
+
+void LfpLatencyTrackCache::AlignedDeleter::operator()(float *p) const
+{
+    ::operator delete[](p, std::align_val_t(TRACK_CACHE_ALIGNMENT));
+}
+
+LfpLatencyTrackCache::LfpLatencyTrackCache()
+    : numChannels(0), numTracks(0), samplesPerTrack(0), preTriggerSamples(0), preTriggerStride(0), rowStride(0), lastPublishedTrack(-1)
+{
+}
+
+LfpLatencyTrackCache::~LfpLatencyTrackCache()
+{
+}
+
+void LfpLatencyTrackCache::allocate(int newNumChannels, int newNumTracks, int newSamplesPerTrack, int newPreTriggerSamples)
+{
+    constexpr size_t floatsPerLine = TRACK_CACHE_ALIGNMENT / sizeof(float);
+
+    numChannels = jmax(1, newNumChannels);
+    numTracks = jmax(1, newNumTracks);
+    samplesPerTrack = jmax(1, newSamplesPerTrack);
+    preTriggerSamples = jmax(0, newPreTriggerSamples);
+    preTriggerStride = ((preTriggerSamples + floatsPerLine - 1) / floatsPerLine) * floatsPerLine;
+    rowStride = preTriggerStride + ((samplesPerTrack + floatsPerLine - 1) / floatsPerLine) * floatsPerLine;
+
+    size_t numFloats = rowStride * numTracks * numChannels;
+    samples.reset(static_cast<float *>(::operator new[](numFloats * sizeof(float), std::align_val_t(TRACK_CACHE_ALIGNMENT))));
+    FloatVectorOperations::clear(samples.get(), static_cast<int>(numFloats));
+
+    slots.reset(new Slot[numTracks]);
+    lastPublishedTrack = -1;
+}
+
+int LfpLatencyTrackCache::getNumChannels() const
+{
+    return numChannels;
+}
+
+int LfpLatencyTrackCache::getNumTracks() const
+{
+    return numTracks;
+}
+
+int LfpLatencyTrackCache::getSamplesPerTrack() const
+{
+    return samplesPerTrack;
+}
+
+int LfpLatencyTrackCache::getPreTriggerSamples() const
+{
+    return preTriggerSamples;
+}
+
+void LfpLatencyTrackCache::beginTrack(const TrackMetadata &metadata)
+{
+    // Readers must not trust this slot until it is published again
+    auto &slot = slots[metadata.track % numTracks];
+    slot.sequence.store(slot.sequence.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    slot.metadata = metadata;
+    slot.metadata.validLength = 0;
+}
+
+float *LfpLatencyTrackCache::getRow(int channel, int64 track)
+{
+    return getRowStart(channel, track);
+}
+
+float *LfpLatencyTrackCache::getRowStart(int channel, int64 track) const
+{
+    return samples.get() + (channel * static_cast<size_t>(numTracks) + track % numTracks) * rowStride + preTriggerStride;
+}
+
+const TrackMetadata &LfpLatencyTrackCache::getMetadata(int64 track) const
+{
+    return slots[track % numTracks].metadata;
+}
+
+const TrackMetadata &LfpLatencyTrackCache::publishTrack(int64 track, int length)
+{
+    auto &slot = slots[track % numTracks];
+    slot.metadata.validLength = length;
+    slot.sequence.store(slot.sequence.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    lastPublishedTrack.store(track, std::memory_order_release);
+    return slot.metadata;
+}
+
+int64 LfpLatencyTrackCache::getLastPublishedTrack() const
+{
+    return lastPublishedTrack.load(std::memory_order_acquire);
+}
+
+int LfpLatencyTrackCache::readTrack(int channel, int64 track, int startSample, int numSamples, float *dest) const
+{
+    if (channel < 0 || channel >= numChannels || track < 0 || track > getLastPublishedTrack() || startSample < -preTriggerSamples || numSamples < 0 || startSample + numSamples > samplesPerTrack)
+    {
+        return -1;
+    }
+    const auto &slot = slots[track % numTracks];
+
+    // Sequence lock read: the copy is only valid if the slot was stable and unchanged throughout
+    uint32_t sequenceBefore = slot.sequence.load(std::memory_order_acquire);
+    if ((sequenceBefore & 1) != 0 || slot.metadata.track != track)
+    {
+        return -1;
+    }
+
+    // Rows are not cleared, anything outside the written pre-trigger and published length belongs to an older track
+    int numValid = jlimit(0, numSamples, slot.metadata.validLength - startSample);
+    int numMissing = jlimit(0, numValid, -slot.metadata.preTriggerLength - startSample);
+    std::memset(dest, 0, numMissing * sizeof(float));
+    std::memcpy(dest + numMissing, getRowStart(channel, track) + startSample + numMissing, (numValid - numMissing) * sizeof(float));
+    std::atomic_thread_fence(std::memory_order_acquire);
+    return slot.sequence.load(std::memory_order_relaxed) == sequenceBefore ? numValid : -1;
+}
+
+bool LfpLatencyTrackCache::readMetadata(int64 track, TrackMetadata &dest) const
+{
+    if (track < 0 || track > getLastPublishedTrack())
+    {
+        return false;
+    }
+    const auto &slot = slots[track % numTracks];
+
+    uint32_t sequenceBefore = slot.sequence.load(std::memory_order_acquire);
+    if ((sequenceBefore & 1) != 0)
+    {
+        return false;
+    }
+    dest = slot.metadata;
+    std::atomic_thread_fence(std::memory_order_acquire);
+    return slot.sequence.load(std::memory_order_relaxed) == sequenceBefore && dest.track == track;
+}
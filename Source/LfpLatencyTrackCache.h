@@ -0,0 +1,129 @@
+/*
+    ------------------------------------------------------------------
+
+    This file is part of APTrack, a plugin for the Open-Ephys Gui
+
+    Copyright (C) 2019-2023 Eli Lilly and Company, University of Bristol, Open Ephys
+    Authors: Aidan Nickerson, Grace Stangroome, Merle Zhang, James O'Sullivan, Manuel Martinez
+
+    ------------------------------------------------------------------
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef LFPLATENCYTRACKCACHE_H_INCLUDED
+#define LFPLATENCYTRACKCACHE_H_INCLUDED
+
+#include <ProcessorHeaders.h>
+#include <atomic>
+#include <memory>
+
+// Alignment of each track row and metadata record, one cache line
+#define TRACK_CACHE_ALIGNMENT 64
+
+/** Description of a cached track, written by the audio thread when the track starts and when it is published */
+struct TrackMetadata
+{
+    int64 track = -1;            // track number (currentTrack), -1 for an empty slot
+    int64 startSample = 0;       // recording sample number of the stimulus onset
+    float stimulusVoltage = 0;   // stimulus voltage requested from the PulsePal at onset
+    float triggerAmplitude = 0;  // trigger channel value at the onset sample
+    int validLength = 0;         // samples written to the row, 0 until the track is published
+    int preTriggerLength = 0;    // samples before the onset copied into the row
+};
+
+/**
+    Ring of the most recent tracks, one row of samples per channel per stimulus.
+    Rows are stored channel-major, so the history of one channel is contiguous.
+    Each row starts with room for samples before the stimulus, sample 0 is the stimulus onset
+    and pre-trigger samples have negative indices.
+
+    The audio thread is the only writer. A track is written into its slot and then published,
+    readers on other threads copy published tracks through readTrack(), which never blocks the writer.
+*/
+class LfpLatencyTrackCache
+{
+public:
+    LfpLatencyTrackCache();
+    ~LfpLatencyTrackCache();
+
+    /** Allocates aligned storage for numTracks tracks of preTriggerSamples + samplesPerTrack samples on numChannels
+        channels and forgets all tracks. Must not be called while the audio thread is writing. */
+    void allocate(int numChannels, int numTracks, int samplesPerTrack, int preTriggerSamples = 0);
+
+    int getNumChannels() const;
+    int getNumTracks() const;
+    int getSamplesPerTrack() const;
+    int getPreTriggerSamples() const;
+
+    /** Marks the slot of a track as being written and records its metadata. Audio thread only.
+        Rows are not cleared, samples past the published length are never read. */
+    void beginTrack(const TrackMetadata &metadata);
+
+    /** Returns the onset sample of a row of a track that is being written, pre-trigger samples precede it. Audio thread only. */
+    float *getRow(int channel, int64 track);
+
+    /** Returns the metadata of a track that is being written. Audio thread only. */
+    const TrackMetadata &getMetadata(int64 track) const;
+
+    /** Marks a track with validLength written samples as finished so readers may copy it. Audio thread only.
+        Returns the metadata as published. */
+    const TrackMetadata &publishTrack(int64 track, int validLength);
+
+    /** Returns the number of the most recent published track, or -1 if there is none */
+    int64 getLastPublishedTrack() const;
+
+    /**
+     Copies the written samples of one channel of a published track in [startSample, startSample + numSamples),
+     startSample may be negative to read before the onset. Pre-trigger samples that were never written read as 0.
+     - Returns: the number of samples copied, which stops short of numSamples where the track ended,
+       or -1 if the track is not published or was overwritten during the copy, dest is then undefined
+     */
+    int readTrack(int channel, int64 track, int startSample, int numSamples, float *dest) const;
+
+    /** Copies the metadata of a published track, returns false if the track is no longer (or not yet) readable */
+    bool readMetadata(int64 track, TrackMetadata &dest) const;
+
+private:
+    struct AlignedDeleter
+    {
+        void operator()(float *p) const;
+    };
+
+    std::unique_ptr<float[], AlignedDeleter> samples;
+    int numChannels;
+    int numTracks;
+    int samplesPerTrack;
+    int preTriggerSamples;
+    size_t preTriggerStride; // preTriggerSamples rounded up to whole cache lines, so the onset sample stays aligned
+    size_t rowStride;        // preTriggerStride plus samplesPerTrack rounded up to whole cache lines
+
+    /** Returns the onset sample of a row */
+    float *getRowStart(int channel, int64 track) const;
+
+    // One cache line per slot, so slots written by the audio thread never share a line with ones being read
+    struct alignas(TRACK_CACHE_ALIGNMENT) Slot
+    {
+        std::atomic<uint32_t> sequence{0}; // odd while the audio thread is writing the slot
+        TrackMetadata metadata;
+    };
+
+    std::unique_ptr<Slot[]> slots;
+    std::atomic<int64> lastPublishedTrack;
+
+    JUCE_DECLARE_NON_COPYABLE(LfpLatencyTrackCache);
+};
+
+#endif // LFPLATENCYTRACKCACHE_H_INCLUDED
@@ -0,0 +1,117 @@
+/*
+    ------------------------------------------------------------------
+
+    This file is part of APTrack, a plugin for the Open-Ephys Gui
+
+    Copyright (C) 2019-2023 Eli Lilly and Company, University of Bristol, Open Ephys
+    Authors: Aidan Nickerson, Grace Stangroome, Merle Zhang, James O'Sullivan, Manuel Martinez
+
+    ------------------------------------------------------------------
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include "LfpLatencyTrackLog.h"
+
+LfpLatencyTrackLog::LfpLatencyTrackLog()
+    : Thread("APTrack track log"), fifo(TRACK_LOG_CAPACITY), records(TRACK_LOG_CAPACITY), droppedRecords(0)
+{
+}
+
+LfpLatencyTrackLog::~LfpLatencyTrackLog()
+{
+    stop();
+}
+
+void LfpLatencyTrackLog::start()
+{
+    stop();
+
+    fifo.reset();
+    droppedRecords = 0;
+
+    File logFile = CoreServices::getSavedStateDirectory().getChildFile("APTrack_tracks_" + Time::getCurrentTime().formatted("%Y-%m-%d_%H-%M-%S") + ".csv");
+    output.reset(new FileOutputStream(logFile));
+    if (!output->openedOk())
+    {
+        std::cout << "Track log did not open correctly" << std::endl;
+        output.reset();
+        return;
+    }
+    output->writeText("track,startSample,stimulusVoltage,triggerAmplitude,validLength,preTriggerLength\n", false, false, "\n");
+
+    startThread();
+}
+
+void LfpLatencyTrackLog::stop()
+{
+    stopThread(1000);
+    if (output == nullptr)
+    {
+        return;
+    }
+
+    writePending();
+    if (droppedRecords > 0)
+    {
+        std::cout << "Track log dropped " << droppedRecords << " records" << std::endl;
+    }
+    output->flush();
+    output.reset();
+}
+
+void LfpLatencyTrackLog::push(const TrackMetadata &metadata)
+{
+    if (fifo.getFreeSpace() == 0)
+    {
+        droppedRecords++;
+        return;
+    }
+    int start1, size1, start2, size2;
+    fifo.prepareToWrite(1, start1, size1, start2, size2);
+    records[start1] = metadata;
+    fifo.finishedWrite(1);
+}
+
+void LfpLatencyTrackLog::run()
+{
+    while (!threadShouldExit())
+    {
+        writePending();
+        wait(200);
+    }
+}
+
+void LfpLatencyTrackLog::writePending()
+{
+    int numReady = fifo.getNumReady();
+    if (numReady == 0 || output == nullptr)
+    {
+        return;
+    }
+
+    int start1, size1, start2, size2;
+    fifo.prepareToRead(numReady, start1, size1, start2, size2);
+    String lines;
+    for (int i = 0; i < size1 + size2; i++)
+    {
+        const auto &r = records[i < size1 ? start1 + i : start2 + i - size1];
+        lines += String(r.track) + "," + String(r.startSample) + "," + String(r.stimulusVoltage, 3) + "," + String(r.triggerAmplitude, 3) + "," + String(r.validLength) + "," + String(r.preTriggerLength) + "\n";
+    }
+    fifo.finishedRead(size1 + size2);
+
+    output->writeText(lines, false, false, "\n");
+    output->flush();
+}
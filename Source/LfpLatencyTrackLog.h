@@ -0,0 +1,73 @@
+/*
+    ------------------------------------------------------------------
+
+    This file is part of APTrack, a plugin for the Open-Ephys Gui
+
+    Copyright (C) 2019-2023 Eli Lilly and Company, University of Bristol, Open Ephys
+    Authors: Aidan Nickerson, Grace Stangroome, Merle Zhang, James O'Sullivan, Manuel Martinez
+
+    ------------------------------------------------------------------
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef LFPLATENCYTRACKLOG_H_INCLUDED
+#define LFPLATENCYTRACKLOG_H_INCLUDED
+
+#include <ProcessorHeaders.h>
+#include "LfpLatencyTrackCache.h"
+#include <atomic>
+#include <memory>
+#include <vector>
+
+// Number of track records that can wait for the writer thread
+#define TRACK_LOG_CAPACITY 4096
+
+/**
+    Append-only log of every published track, one CSV line per stimulus.
+
+    The audio thread pushes records into a lock-free fifo; a background thread writes them to
+    a file in the saved state directory so the audio thread never touches the disk.
+*/
+class LfpLatencyTrackLog : public Thread
+{
+public:
+    LfpLatencyTrackLog();
+    ~LfpLatencyTrackLog();
+
+    /** Opens a new log file and starts the writer thread. Call before acquisition starts. */
+    void start();
+
+    /** Stops the writer thread, writes any remaining records and closes the file. Call after acquisition stops. */
+    void stop();
+
+    /** Queues a record without blocking. Audio thread only. The record is dropped if the writer has fallen behind. */
+    void push(const TrackMetadata &metadata);
+
+    void run() override;
+
+private:
+    /** Writes every queued record to the file */
+    void writePending();
+
+    AbstractFifo fifo;
+    std::vector<TrackMetadata> records;
+    std::unique_ptr<FileOutputStream> output;
+    std::atomic<int> droppedRecords;
+
+    JUCE_DECLARE_NON_COPYABLE(LfpLatencyTrackLog);
+};
+
+#endif // LFPLATENCYTRACKLOG_H_INCLUDED
@@ -0,0 +1,106 @@
+/*
+    ------------------------------------------------------------------
+
+    This file is part of APTrack, a plugin for the Open-Ephys Gui
+
+    Copyright (C) 2019-2023 Eli Lilly and Company, University of Bristol, Open Ephys
+    Authors: Aidan Nickerson, Grace Stangroome, Merle Zhang, James O'Sullivan, Manuel Martinez
+
+    ------------------------------------------------------------------
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include "LfpLatencyWindowPredictor.h"
+
+LfpLatencyWindowPredictor::LfpLatencyWindowPredictor()
+    : latency(0), velocity(0), p00(0), p01(0), p11(0), measurementVariance(1), accelerationVariance(0), minWindow(1), maxWindow(0), publishedLatency(-1), detected(false)
+{
+}
+
+void LfpLatencyWindowPredictor::reset(int newLatency, int newMaxWindow, float sampleRate)
+{
+    float samplesPerMs = sampleRate / 1000.0f;
+    measurementVariance = jmax(0.25f, WINDOW_MEASUREMENT_NOISE_MS * samplesPerMs * WINDOW_MEASUREMENT_NOISE_MS * samplesPerMs);
+    accelerationVariance = WINDOW_ACCELERATION_MS * samplesPerMs * WINDOW_ACCELERATION_MS * samplesPerMs;
+    maxWindow = jmax(0, newMaxWindow);
+    minWindow = jmin(maxWindow, jmax(1, roundToInt(MIN_WINDOW_MS * samplesPerMs)));
+
+    // Nothing is known yet beyond the window the user drew, and that the fibre is not expected to move
+    latency = static_cast<float>(newLatency);
+    velocity = 0;
+    float windowSigma = maxWindow / WINDOW_SIGMAS;
+    p00 = jmax(0.0f, windowSigma * windowSigma - measurementVariance);
+    p01 = 0;
+    p11 = accelerationVariance;
+    publishedLatency = newLatency;
+    detected = false;
+}
+
+bool LfpLatencyWindowPredictor::follows(int newLatency, int newMaxWindow) const
+{
+    return newLatency == publishedLatency && newMaxWindow == maxWindow;
+}
+
+void LfpLatencyWindowPredictor::predict()
+{
+    // Constant velocity, with a random change of velocity between tracks. A miss does not confirm the
+    // drift, so the window is not walked away from the unit, it only widens
+    if (detected)
+    {
+        latency += velocity;
+    }
+    else
+    {
+        velocity *= WINDOW_MISS_VELOCITY_DECAY;
+    }
+    detected = false;
+    p00 += 2 * p01 + p11 + 0.25f * accelerationVariance;
+    p01 += p11 + 0.5f * accelerationVariance;
+    p11 += accelerationVariance;
+}
+
+int LfpLatencyWindowPredictor::update(float measuredLatency)
+{
+    float innovation = measuredLatency - latency;
+    float innovationVariance = p00 + measurementVariance;
+    float gainLatency = p00 / innovationVariance;
+    float gainVelocity = p01 / innovationVariance;
+    latency += gainLatency * innovation;
+    velocity += gainVelocity * innovation;
+    p11 -= gainVelocity * p01;
+    p01 -= gainLatency * p01;
+    p00 -= gainLatency * p00;
+    publishedLatency = roundToInt(latency);
+    detected = true;
+    return publishedLatency;
+}
+
+float LfpLatencyWindowPredictor::getLatency() const
+{
+    return latency;
+}
+
+float LfpLatencyWindowPredictor::getVelocity() const
+{
+    return velocity;
+}
+
+int LfpLatencyWindowPredictor::getWindow() const
+{
+    // Room for both the uncertainty of the prediction and the scatter of the next detection
+    int window = static_cast<int>(std::ceil(WINDOW_SIGMAS * std::sqrt(p00 + measurementVariance)));
+    return jlimit(minWindow, maxWindow, window);
+}
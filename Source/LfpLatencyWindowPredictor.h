@@ -0,0 +1,85 @@
+/*
+    ------------------------------------------------------------------
+
+    This file is part of APTrack, a plugin for the Open-Ephys Gui
+
+    Copyright (C) 2019-2023 Eli Lilly and Company, University of Bristol, Open Ephys
+    Authors: Aidan Nickerson, Grace Stangroome, Merle Zhang, James O'Sullivan, Manuel Martinez
+
+    ------------------------------------------------------------------
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef LFPLATENCYWINDOWPREDICTOR_H_INCLUDED
+#define LFPLATENCYWINDOWPREDICTOR_H_INCLUDED
+
+#include <ProcessorHeaders.h>
+
+#define WINDOW_MEASUREMENT_NOISE_MS 0.05f // spread of a detected latency around the true one
+#define WINDOW_ACCELERATION_MS 0.02f      // change of the latency velocity expected from one track to the next
+#define WINDOW_SIGMAS 3.0f                // half-width of the search window in predicted standard deviations
+#define MIN_WINDOW_MS 0.2f                // narrowest search window half-width
+#define WINDOW_MISS_VELOCITY_DECAY 0.5f   // fraction of the velocity kept over a track without a detection
+
+/**
+    Kalman filter on the latency and latency velocity of a spike group.
+
+    The state is the latency in samples and its change per track. Each track the prediction moves the
+    latency on by the velocity and grows the uncertainty, a detection pulls both back towards the
+    measurement. The search window is centred on the predicted latency and sized from its uncertainty,
+    so a steadily slowing fibre is followed by a narrow window, a single noise peak only moves the window
+    by the Kalman gain and missed tracks widen it again up to the window the user set. Only a detection
+    lets the window move on by the velocity, after a miss the velocity decays and the window stays put.
+*/
+class LfpLatencyWindowPredictor
+{
+public:
+    LfpLatencyWindowPredictor();
+
+    /** Starts from a window the user placed, with half-width maxWindow in samples */
+    void reset(int latency, int maxWindow, float sampleRate);
+
+    /** Returns true if the predictor was reset from (or last published) this window, false once the user has moved it */
+    bool follows(int latency, int maxWindow) const;
+
+    /** Advances the state by one track, moving the latency only if the last track had a detection */
+    void predict();
+
+    /** Corrects the state with a detected latency, returns the new latency estimate rounded to a sample */
+    int update(float measuredLatency);
+
+    /** Returns the estimated latency in samples */
+    float getLatency() const;
+
+    /** Returns the estimated change of the latency per track in samples */
+    float getVelocity() const;
+
+    /** Returns the half-width of the search window for the predicted latency */
+    int getWindow() const;
+
+private:
+    float latency;
+    float velocity;
+    float p00, p01, p11; // state covariance
+    float measurementVariance;
+    float accelerationVariance;
+    int minWindow;
+    int maxWindow;
+    int publishedLatency; // latency last handed to the spike group, to notice the user moving it
+    bool detected;        // the state has been updated with a detection since the last prediction
+};
+
+#endif // LFPLATENCYWINDOWPREDICTOR_H_INCLUDED
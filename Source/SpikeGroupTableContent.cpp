@@ -41,17 +41,30 @@ SpikeGroupTableContent::~SpikeGroupTableContent()
 void SpikeGroupTableContent::paintCell(Graphics &g, int rowNumber, int columnId, int width, int height, bool rowIsSelected)
 {
 
+    auto spikeGroup = processor->getSpikeGroup(rowNumber);
+    if (spikeGroup == nullptr)
+    {
+        return;
+    }
+
     g.setColour(Colours::black); // [5]
     Font font = 12.0f;
     g.setFont(font);
 
     if (columnId == Columns::spike_id_info)
     {
-        auto text = std::to_string(rowNumber + 1); // #TODO this should get ID from spikeGroup
+        auto text = std::to_string(spikeGroup->uid);
 
         g.drawText(text, 2, 0, width - 4, height, juce::Justification::centredLeft, true); // [6]
     }
 
+    if (columnId == Columns::channel_info)
+    {
+        auto text = std::to_string(spikeGroup->templateSpike.channel + 1);
+
+        g.drawText(text, 2, 0, width - 4, height, juce::Justification::centredLeft, true);
+    }
+
     g.setColour(Colours::transparentWhite);
     g.fillRect(width - 1, 0, 1, height);
 }
@@ -74,15 +87,20 @@ Component *SpikeGroupTableContent::refreshComponentForCell(int rowNumber, int co
     if (rowNumber < getNumRows())
     {
         auto spikeGroup = processor->getSpikeGroup(rowNumber);
-        ;
+        if (spikeGroup == nullptr)
+        {
+            // Removed since the row count was taken
+            return existingComponentToUpdate;
+        }
         if (columnId == Columns::delete_button)
         {
             auto *deleteButton = static_cast<DeleteComponent *>(existingComponentToUpdate);
 
             if (deleteButton == nullptr)
             {
-                deleteButton = new DeleteComponent(*this);
+                deleteButton = new DeleteComponent(*this, rowNumber, processor);
             }
+            deleteButton->setSpikeID(rowNumber);
             return deleteButton;
         }
         if (columnId == Columns::track_spike_button)
@@ -118,7 +136,7 @@ Component *SpikeGroupTableContent::refreshComponentForCell(int rowNumber, int co
             }
             std::ostringstream ss_ms_latency;
 
-            ss_ms_latency << std::fixed << std::setprecision(2) << (spikeGroup->templateSpike.spikeSampleLatency * 1000) / this->processor->getSampleRate(0);
+            ss_ms_latency << std::fixed << std::setprecision(3) << (spikeGroup->templateSpike.spikeLatencyFine * 1000) / this->processor->getDataSampleRate();
             label->setText(ss_ms_latency.str() + "ms", juce::NotificationType::dontSendNotification);
             label->repaint();
             return label;
@@ -131,7 +149,7 @@ Component *SpikeGroupTableContent::refreshComponentForCell(int rowNumber, int co
             {
                 label = new UpdatingTextColumnComponent(*this, rowNumber, columnId);
             }
-            label->setText(std::to_string(100 * std::count(spikeGroup->recentHistory.begin(), spikeGroup->recentHistory.end(), true) / spikeGroup->recentHistory.size()), juce::NotificationType::dontSendNotification);
+            label->setText(std::to_string(roundToInt(100 * spikeGroup->firingHistory.getFiringProbability())), juce::NotificationType::dontSendNotification);
             label->repaint();
 
             return label;
@@ -207,7 +225,7 @@ void SpikeGroupTableContent::SelectableColumnComponent::buttonClicked(juce::Butt
     if (action == Action::ACTIVATE_SPIKE)
         processor->setSelectedSpike(newSpikeID);
     else if (action == Action::TRACK_SPIKE)
-        processor->setTrackingSpike(newSpikeID);
+        processor->setSpikeGroupTracking(spikeID, b->getToggleState());
 }
 void SpikeGroupTableContent::SelectableColumnComponent::setSpikeID(int spikeID)
 {
@@ -218,17 +236,20 @@ SpikeGroupTableContent::SelectableColumnComponent::~SelectableColumnComponent()
     toggleButton = nullptr;
 }
 
-SpikeGroupTableContent::DeleteComponent::DeleteComponent(SpikeGroupTableContent &tcon) : owner(tcon)
+SpikeGroupTableContent::DeleteComponent::DeleteComponent(SpikeGroupTableContent &tcon, int spikeID, LfpLatencyProcessor *processor) : owner(tcon), spikeID(spikeID)
 {
-    addAndMakeVisible(del = new TextButton);
-    del->setColour(TextButton::ColourIds::buttonColourId, Colours::white);
+    this->processor = processor;
+    // The component is the button itself, it listens to its own clicks
+    setColour(TextButton::ColourIds::buttonColourId, Colours::white);
+    setButtonText("X");
+    this->addListener(this);
 }
 
-SpikeGroupTableContent::DeleteComponent::~DeleteComponent()
+void SpikeGroupTableContent::DeleteComponent::buttonClicked(juce::Button *b)
 {
-    del = nullptr;
+    processor->removeSpikeGroup(spikeID);
 }
-// void SpikeGroupTableContent::DeleteComponent::buttonClicked(juce::Button *b){
-
-// 	processor->removeSpikeGroup(spikeID);
-// }
\ No newline at end of file
+void SpikeGroupTableContent::DeleteComponent::setSpikeID(int spikeID)
+{
+    this->spikeID = spikeID;
+}
\ No newline at end of file
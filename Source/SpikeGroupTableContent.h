@@ -42,7 +42,8 @@ public:
         track_spike_button = 5,
         threshold_spike_button = 6,
         delete_button = 7,
-        pct50stimulus = 8
+        pct50stimulus = 8,
+        channel_info = 9
     };
     const juce::Colour colorWheel[4] = {Colours::lightsteelblue, Colours::lightskyblue, Colours::darkgreen, Colours::orange};
     SpikeGroupTableContent(LfpLatencyProcessor *processor);
@@ -97,17 +98,18 @@ public:
         SpikeGroupTableContent &owner;
         juce::Colour textColour = juce::Colours::black;
     };
-    class DeleteComponent : public juce::TextButton
+    class DeleteComponent : public juce::TextButton, public juce::TextButton::Listener
 
     {
     public:
-        DeleteComponent(SpikeGroupTableContent &tcon);
-        ~DeleteComponent();
-
-        ScopedPointer<TextButton> del;
+        DeleteComponent(SpikeGroupTableContent &tcon, int spikeID, LfpLatencyProcessor *processor);
+        void buttonClicked(juce::Button *b) override;
+        void setSpikeID(int spikeID);
 
     private:
+        LfpLatencyProcessor *processor;
         SpikeGroupTableContent &owner;
+        int spikeID;
     };
 
 private: